@@ -0,0 +1,130 @@
+// Cost of decoding a RESERVE request, from 1 to 256 seats, in the binary frames the session reads and in the text
+// requests the worker used to parse with sscanf.
+// The text requests had to fit in a buffer of TEXT_BUFFER_SIZE bytes, so the larger ones could not be sent at all;
+// they are still decoded here for comparison.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "common/codec.h"
+#include "common/constants.h"
+
+#define ITERATIONS 20000     // Decodes of each request per size
+#define TEXT_BUFFER_SIZE 100  // Size of the buffer the text requests were read into
+#define TEXT_REQUEST_SIZE 4096
+
+/// Gets the next number of a xorshift sequence, so requests hold seats of varying lengths as text.
+/// @param state State of the sequence (never 0).
+/// @return Next number.
+static uint32_t next_random(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/// Gets the time elapsed since a moment.
+/// @param start Moment to measure from (CLOCK_MONOTONIC).
+/// @return Nanoseconds since start.
+static double elapsed_ns(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/// Decodes a text RESERVE request the way the worker did: the header with one sscanf, then each seat with another,
+/// skipping what was parsed so far by printing it again to measure its length.
+/// @param request Text request (" 4 <event_id> <num_seats> <row> <col>...").
+/// @param event_id Pointer to store the event id in.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return Number of seats decoded.
+static size_t decode_text(const char* request, unsigned int* event_id, size_t* xs, size_t* ys) {
+  char command, header[TEXT_REQUEST_SIZE];
+  size_t num_seats;
+  if (sscanf(request, " %c %u %zu", &command, event_id, &num_seats) != 3 || num_seats > MAX_RESERVATION_SIZE) return 0;
+  snprintf(header, sizeof(header), "%c %u %zu", command, *event_id, num_seats);
+
+  size_t offset = strlen(header) + 1;
+  for (size_t i = 0; i < num_seats; ++i) {
+    if (sscanf(request + offset, " %zu %zu", &xs[i], &ys[i]) != 2) return i;
+    char seat[TEXT_REQUEST_SIZE];
+    snprintf(seat, sizeof(seat), "%zu %zu", xs[i], ys[i]);
+    offset += strlen(seat) + 1;
+  }
+  return num_seats;
+}
+
+/// Decodes the payload of a binary RESERVE request the way the session does.
+/// @param payload Payload of the request.
+/// @param size Size of the payload.
+/// @param event_id Pointer to store the event id in.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return Number of seats decoded.
+static size_t decode_binary(const void* payload, size_t size, uint32_t* event_id, size_t* xs, size_t* ys) {
+  struct Decoder dec;
+  uint64_t count;
+  decode_begin(&dec, payload, size);
+  if (decode_u32(&dec, event_id) != 0 || decode_u64(&dec, &count) != 0 || count > MAX_RESERVATION_SIZE) return 0;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t row, col;
+    if (decode_u64(&dec, &row) != 0 || decode_u64(&dec, &col) != 0) return i;
+    xs[i] = row;
+    ys[i] = col;
+  }
+  return count;
+}
+
+int main(void) {
+  static unsigned char frame[FRAME_HEADER_SIZE + MAX_REQUEST_PAYLOAD];
+  static char text[TEXT_REQUEST_SIZE];
+  size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+  uint32_t state = 2463534242u;
+
+  printf("%6s %14s %12s %16s\n", "seats", "text ns", "binary ns", "text fits");
+  for (size_t num_seats = 1; num_seats <= MAX_RESERVATION_SIZE; num_seats *= 4) {
+    // The same seats, with rows and columns of one or two digits, encoded both ways
+    struct Encoder enc;
+    encode_begin(&enc, frame, sizeof(frame), OP_RESERVE);
+    encode_u32(&enc, 1);
+    encode_u64(&enc, num_seats);
+    int length = snprintf(text, sizeof(text), " 4 %u %zu", 1u, num_seats);
+    for (size_t i = 0; i < num_seats; i++) {
+      size_t row = next_random(&state) % 20 + 1, col = next_random(&state) % 20 + 1;
+      encode_u64(&enc, row);
+      encode_u64(&enc, col);
+      length += snprintf(text + length, sizeof(text) - (size_t)length, " %zu %zu", row, col);
+    }
+    if (enc.overflow || (size_t)length >= sizeof(text)) {
+      fprintf(stderr, "Error encoding %zu seats\n", num_seats);
+      return 1;
+    }
+
+    size_t decoded = 0;
+    unsigned int text_event_id;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < ITERATIONS; i++) decoded += decode_text(text, &text_event_id, xs, ys);
+    double text_ns = elapsed_ns(&start) / ITERATIONS;
+
+    uint32_t binary_event_id;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < ITERATIONS; i++) {
+      decoded += decode_binary(frame + FRAME_HEADER_SIZE, enc.size - FRAME_HEADER_SIZE, &binary_event_id, xs, ys);
+    }
+    double binary_ns = elapsed_ns(&start) / ITERATIONS;
+
+    if (decoded != 2 * ITERATIONS * num_seats) {
+      fprintf(stderr, "Error decoding %zu seats\n", num_seats);
+      return 1;
+    }
+    char fits[32];
+    snprintf(fits, sizeof(fits), "%s (%d B)", (size_t)length < TEXT_BUFFER_SIZE ? "yes" : "no", length + 1);
+    printf("%6zu %14.1f %12.1f %16s\n", num_seats, text_ns, binary_ns, fits);
+  }
+  return 0;
+}
@@ -0,0 +1,198 @@
+// Latency of reservations when every thread reserves on the same event, under each reservation engine.
+// Each round creates a 16x16 event that WRITERS threads fill with random 4-seat reservations while a reader
+// keeps showing it, and checks that every reservation it sees holds all of its 4 seats.
+// Writers only contend for real with the CPUs the machine has: past that, they take turns on the same cores.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "common/codec.h"
+#include "common/constants.h"
+#include "server/operations.h"
+
+#define ROUNDS 50
+#define WRITERS 8
+#define ATTEMPTS 48  // Reservations each writer attempts per round
+#define SEATS_PER_RESERVATION 4
+#define NUM_ROWS 16
+#define NUM_COLS 16
+#define EVENT_ID 1
+
+// Writer thread, timing each of its reservations
+struct Writer {
+  pthread_t thread;
+  uint32_t seed;
+  double latencies_ns[ATTEMPTS];
+  size_t successes;
+};
+
+// Reader thread, showing the event until told to stop
+struct Reader {
+  pthread_t thread;
+  unsigned long shows;
+  unsigned long partial;  // Shows where a reservation held other than SEATS_PER_RESERVATION seats
+};
+
+static atomic_bool stop = false;
+
+/// Gets the next number of a xorshift sequence, so reservations pick seats in no particular order.
+/// @param state State of the sequence (never 0).
+/// @return Next number.
+static uint32_t next_random(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/// Gets the time elapsed since a moment.
+/// @param start Moment to measure from (CLOCK_MONOTONIC).
+/// @return Nanoseconds since start.
+static double elapsed_ns(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+static void* writer_loop(void* arg) {
+  struct Writer* writer = arg;
+  for (size_t i = 0; i < ATTEMPTS; i++) {
+    size_t xs[SEATS_PER_RESERVATION], ys[SEATS_PER_RESERVATION];
+    for (size_t j = 0; j < SEATS_PER_RESERVATION; j++) {
+      // Seats of a request must be distinct, or it fails for a reason other than contention
+      bool repeated;
+      do {
+        xs[j] = next_random(&writer->seed) % NUM_ROWS + 1;
+        ys[j] = next_random(&writer->seed) % NUM_COLS + 1;
+        repeated = false;
+        for (size_t k = 0; k < j; k++) repeated |= xs[k] == xs[j] && ys[k] == ys[j];
+      } while (repeated);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    writer->successes += ems_reserve(EVENT_ID, SEATS_PER_RESERVATION, xs, ys) == 0;
+    writer->latencies_ns[i] = elapsed_ns(&start);
+  }
+  return NULL;
+}
+
+/// Checks that every reservation of a SHOW response holds all of its seats.
+/// @param response Response built by ems_show.
+/// @return Whether some reservation held other than SEATS_PER_RESERVATION seats, or the response was malformed.
+static bool is_partial(const struct Encoder* response) {
+  struct Decoder dec;
+  int32_t status;
+  uint64_t rows, cols;
+  decode_begin(&dec, response->data + FRAME_HEADER_SIZE, response->size - FRAME_HEADER_SIZE);
+  if (decode_i32(&dec, &status) != 0 || decode_u64(&dec, &rows) != 0 || decode_u64(&dec, &cols) != 0) return true;
+
+  // Every attempt of a round takes at most one reservation id of its event, successful or not
+  static unsigned int counts[WRITERS * ATTEMPTS + 1];
+  memset(counts, 0, sizeof(counts));
+  const unsigned char* seats = decode_bytes(&dec, rows * cols * sizeof(uint32_t));
+  if (seats == NULL) return true;
+  for (size_t i = 0; i < rows * cols; i++) {
+    uint32_t id;
+    memcpy(&id, seats + i * sizeof(uint32_t), sizeof(id));
+    if (id >= sizeof(counts) / sizeof(counts[0])) return true;
+    counts[id]++;
+  }
+  for (size_t id = 1; id < sizeof(counts) / sizeof(counts[0]); id++) {
+    if (counts[id] != 0 && counts[id] != SEATS_PER_RESERVATION) return true;
+  }
+  return false;
+}
+
+static void* reader_loop(void* arg) {
+  struct Reader* reader = arg;
+  while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+    struct Encoder response;
+    if (ems_show(&response, EVENT_ID) != 0) continue;
+    reader->partial += is_partial(&response);
+    reader->shows++;
+    free(response.data);
+  }
+  return NULL;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+/// Runs ROUNDS rounds of writers and a reader against one engine.
+/// @param engine Reservation engine to run.
+/// @param out Stream to print the results to.
+/// @return Number of partial reservations seen, or -1 on failure.
+static long run_engine(enum ReserveEngine engine, FILE* out) {
+  static double latencies_ns[ROUNDS * WRITERS * ATTEMPTS];
+  static struct Writer writers[WRITERS];
+  size_t successes = 0, measured = 0;
+  struct Reader reader = {0};
+
+  if (ems_init(0, EVENT_SHARD_COUNT, engine, 0) != 0) return -1;
+  for (size_t round = 0; round < ROUNDS; round++) {
+    if (ems_create(EVENT_ID, NUM_ROWS, NUM_COLS) != 0) return -1;
+    atomic_store(&stop, false);
+    if (pthread_create(&reader.thread, NULL, reader_loop, &reader) != 0) return -1;
+    size_t started = 0;
+    for (; started < WRITERS; started++) {
+      writers[started] = (struct Writer){.seed = 2463534242u + (uint32_t)(round * WRITERS + started)};
+      if (pthread_create(&writers[started].thread, NULL, writer_loop, &writers[started]) != 0) break;
+    }
+    for (size_t i = 0; i < started; i++) {
+      pthread_join(writers[i].thread, NULL);
+      successes += writers[i].successes;
+      memcpy(latencies_ns + measured, writers[i].latencies_ns, sizeof(writers[i].latencies_ns));
+      measured += ATTEMPTS;
+    }
+    atomic_store(&stop, true);
+    pthread_join(reader.thread, NULL);
+    if (started != WRITERS || ems_delete(EVENT_ID) != 0) return -1;
+  }
+  if (ems_terminate() != 0) return -1;
+
+  qsort(latencies_ns, measured, sizeof(double), compare_doubles);
+  fprintf(out, "%10s %9zu %9zu %9.1f %9.1f %9.1f %9.1f %9lu %9lu\n", engine == RESERVE_LOCKED ? "locked" : "lockfree",
+          successes, measured - successes, latencies_ns[measured / 2] / 1e3, latencies_ns[measured * 99 / 100] / 1e3,
+          latencies_ns[measured * 999 / 1000] / 1e3, latencies_ns[measured - 1] / 1e3, reader.shows, reader.partial);
+  return (long)reader.partial;
+}
+
+int main(void) {
+  // The operations report every reservation and conflict, which would bury the table
+  FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+  FILE* err = fdopen(dup(STDERR_FILENO), "w");
+  if (out == NULL || err == NULL || freopen("/dev/null", "w", stdout) == NULL ||
+      freopen("/dev/null", "w", stderr) == NULL) {
+    return 1;
+  }
+
+  fprintf(out, "%10s %9s %9s %9s %9s %9s %9s %9s %9s\n", "engine", "reserved", "conflicts", "p50 us", "p99 us",
+          "p99.9 us", "max us", "shows", "partial");
+  long partial = 0;
+  enum ReserveEngine engines[] = {RESERVE_LOCKED, RESERVE_LOCK_FREE};
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+    long seen = run_engine(engines[i], out);
+    if (seen < 0) {
+      fprintf(err, "Error running the engine\n");
+      return 1;
+    }
+    partial += seen;
+  }
+  fclose(out);
+  if (partial != 0) {
+    fprintf(err, "Shows saw %ld partial reservations\n", partial);
+    return 1;
+  }
+  fclose(err);
+  return 0;
+}
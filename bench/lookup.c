@@ -0,0 +1,101 @@
+// Latency of looking an event up by id, from 10 to 1M events in the registry.
+// Each size is looked up through the hash index (get_event), and, up to WALK_MAX_EVENTS, by walking the list
+// from its head the way lookups used to.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "server/epoch.h"
+#include "server/eventlist.h"
+
+#define LOOKUPS 1000000        // Lookups through the index per size
+#define WALK_LOOKUPS 2000      // Lookups by walking the list per size
+#define WALK_MAX_EVENTS 100000  // Largest size the list walk is measured for
+
+/// Gets the next number of a xorshift sequence, so lookups hit the events in no particular order.
+/// @param state State of the sequence (never 0).
+/// @return Next number.
+static uint32_t next_random(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+/// Gets the time elapsed since a moment.
+/// @param start Moment to measure from (CLOCK_MONOTONIC).
+/// @return Nanoseconds since start.
+static double elapsed_ns(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e9 + (double)(now.tv_nsec - start->tv_nsec);
+}
+
+/// Finds an event by walking the list from its head.
+/// @param list List to search.
+/// @param event_id Event id.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* walk_list(struct EventList* list, unsigned int event_id) {
+  for (struct ListNode* node = list->head; node != NULL; node = node->next) {
+    if (node->event->id == event_id) return node->event;
+  }
+  return NULL;
+}
+
+/// Fills a list with events 1 to count.
+/// @return 0 if every event was added, 1 otherwise.
+static int fill_list(struct EventList* list, size_t count) {
+  for (size_t i = 1; i <= count; i++) {
+    struct Event* event = alloc_event(list);
+    if (event == NULL) return 1;
+    // An event without seats, locks or reservations is all the index needs
+    memset(event, 0, sizeof(struct Event));
+    event->id = (unsigned int)i;
+    if (append_to_list(list, event) != 0) return 1;
+  }
+  return 0;
+}
+
+int main(void) {
+  printf("%10s %18s %18s\n", "events", "index ns/lookup", "list ns/lookup");
+
+  for (size_t count = 10; count <= 1000000; count *= 10) {
+    struct EventList* list = create_list();
+    if (list == NULL || fill_list(list, count) != 0) {
+      fprintf(stderr, "Error creating %zu events\n", count);
+      return 1;
+    }
+
+    uint32_t state = 2463534242u;
+    size_t found = 0;
+    struct timespec start;
+    epoch_enter();
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < LOOKUPS; i++) {
+      found += get_event(list, next_random(&state) % (uint32_t)count + 1) != NULL;
+    }
+    double index_ns = elapsed_ns(&start) / LOOKUPS;
+    epoch_exit();
+
+    char walk[32] = "-";
+    if (count <= WALK_MAX_EVENTS) {
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      for (size_t i = 0; i < WALK_LOOKUPS; i++) {
+        found += walk_list(list, next_random(&state) % (uint32_t)count + 1) != NULL;
+      }
+      snprintf(walk, sizeof(walk), "%.1f", elapsed_ns(&start) / WALK_LOOKUPS);
+    }
+
+    if (found != LOOKUPS + (count <= WALK_MAX_EVENTS ? WALK_LOOKUPS : 0)) {
+      fprintf(stderr, "Lookups missed events\n");
+      return 1;
+    }
+    printf("%10zu %18.1f %18s\n", count, index_ns, walk);
+    free_list(list);
+  }
+
+  epoch_drain();
+  return 0;
+}
@@ -0,0 +1,109 @@
+// Time for one session to get NUM_EVENTS pipelined RESERVE requests on distinct events answered, against a server
+// whose state accesses take DELAY_US and whose event cache is off, under each reservation engine.
+// Requests whose accesses are outstanding are parked rather than holding an executor, so every request waits out the
+// same delay at once and the whole pipeline should take about one delay, however few executors there are.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client/api.h"
+#include "common/constants.h"
+
+#define DELAY_US 100000  // Delay of each state access
+#define NUM_EVENTS MAX_REQUESTS_IN_FLIGHT
+#define SERVER_START_MS 200  // Time given to the server to create its pipe
+
+/// Gets the time elapsed since a moment.
+/// @param start Moment to measure from (CLOCK_MONOTONIC).
+/// @return Milliseconds since start.
+static double elapsed_ms(const struct timespec* start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+/// Starts a server in a directory of its own, with its errors discarded.
+/// @param dir Directory the server's pipe is created in.
+/// @param engine Reservation engine of the server ("locked" or "lockfree").
+/// @return Process id of the server, -1 on failure.
+static pid_t start_server(const char* dir, const char* engine) {
+  char server_path[256], delay[32];
+  snprintf(server_path, sizeof(server_path), "%s/server", dir);
+  snprintf(delay, sizeof(delay), "%d", DELAY_US);
+
+  pid_t server = fork();
+  if (server == 0) {
+    if (freopen("/dev/null", "w", stderr) == NULL) _exit(1);
+    execl("server/ems", "server/ems", server_path, delay, "16", engine, "0", (char*)NULL);
+    _exit(1);
+  }
+
+  struct timespec start = {SERVER_START_MS / 1000, (SERVER_START_MS % 1000) * 1000000L};
+  nanosleep(&start, NULL);
+  return server;
+}
+
+/// Creates the events in one batch, then times their pipelined reservations.
+/// @param dir Directory the session's pipes are created in, next to the server's.
+/// @return Milliseconds the reservations took, a negative number on failure.
+static double run_session(const char* dir) {
+  char req_path[256], resp_path[256], server_path[256];
+  snprintf(req_path, sizeof(req_path), "%s/req", dir);
+  snprintf(resp_path, sizeof(resp_path), "%s/resp", dir);
+  snprintf(server_path, sizeof(server_path), "%s/server", dir);
+  if (ems_setup(req_path, resp_path, server_path) != 0) return -1;
+
+  // The creates would reach the server one after the other, so they pay the delay once as a single batch
+  int failed = ems_set_pipeline_depth(NUM_EVENTS) != 0 || ems_set_batch_size(NUM_EVENTS) != 0;
+  for (unsigned int event_id = 1; event_id <= NUM_EVENTS; event_id++) failed |= ems_create(event_id, 2, 2);
+  failed |= ems_flush() | ems_set_batch_size(1);
+
+  size_t x = 1, y = 1;
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int event_id = 1; event_id <= NUM_EVENTS; event_id++) failed |= ems_reserve(event_id, 1, &x, &y);
+  failed |= ems_flush();
+  double reserve_ms = elapsed_ms(&start);
+
+  failed |= ems_quit();
+  return failed ? -1 : reserve_ms;
+}
+
+int main(void) {
+  // The server and the client report their progress, which would bury the table (the server inherits /dev/null)
+  FILE* out = fdopen(dup(STDOUT_FILENO), "w");
+  if (out == NULL || freopen("/dev/null", "w", stdout) == NULL) return 1;
+
+  fprintf(out, "%10s %14s %14s\n", "engine", "reserves ms", "delays");
+  const char* engines[] = {"locked", "lockfree"};
+  for (size_t i = 0; i < sizeof(engines) / sizeof(engines[0]); i++) {
+    char dir[] = "/tmp/ems-pipeline-XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+      fprintf(stderr, "Error creating the directory of the pipes\n");
+      return 1;
+    }
+    pid_t server = start_server(dir, engines[i]);
+    double reserve_ms = server == -1 ? -1 : run_session(dir);
+    if (server != -1) {
+      kill(server, SIGTERM);
+      waitpid(server, NULL, 0);
+    }
+
+    char server_path[256];
+    snprintf(server_path, sizeof(server_path), "%s/server", dir);
+    unlink(server_path);
+    rmdir(dir);
+    if (reserve_ms < 0) {
+      fprintf(stderr, "Error running the session against the %s engine\n", engines[i]);
+      return 1;
+    }
+    fprintf(out, "%10s %14.0f %14.1f\n", engines[i], reserve_ms, reserve_ms * 1000 / DELAY_US);
+  }
+  fclose(out);
+  return 0;
+}
@@ -0,0 +1,115 @@
+// Throughput of event lookups as reader threads are added, in an epoch read-side section as the server does,
+// and under the shard's read lock as it used to.
+// Readers only scale with the CPUs the machine has: past that, the threads share the same cores.
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "server/epoch.h"
+#include "server/eventlist.h"
+
+#define NUM_EVENTS 100000
+#define MAX_READERS 8
+#define RUN_MS 300  // Time each configuration runs for
+
+// Reader thread, counting its lookups until told to stop
+struct Reader {
+  pthread_t thread;
+  struct EventList* list;
+  bool locked;  // Whether lookups take the list's read lock instead of entering an epoch
+  uint32_t seed;
+  unsigned long lookups;
+};
+
+static atomic_bool stop = false;
+
+/// Gets the next number of a xorshift sequence, so lookups hit the events in no particular order.
+/// @param state State of the sequence (never 0).
+/// @return Next number.
+static uint32_t next_random(uint32_t* state) {
+  *state ^= *state << 13;
+  *state ^= *state >> 17;
+  *state ^= *state << 5;
+  return *state;
+}
+
+static void* reader_loop(void* arg) {
+  struct Reader* reader = arg;
+  unsigned long lookups = 0, found = 0;
+  while (!atomic_load_explicit(&stop, memory_order_relaxed)) {
+    unsigned int event_id = next_random(&reader->seed) % NUM_EVENTS + 1;
+    if (reader->locked) {
+      pthread_rwlock_rdlock(&reader->list->rwl);
+      found += get_event(reader->list, event_id) != NULL;
+      pthread_rwlock_unlock(&reader->list->rwl);
+    } else {
+      epoch_enter();
+      found += get_event(reader->list, event_id) != NULL;
+      epoch_exit();
+    }
+    lookups++;
+  }
+  if (found != lookups) fprintf(stderr, "Lookups missed events\n");
+  reader->lookups = lookups;
+  return NULL;
+}
+
+/// Runs readers for RUN_MS.
+/// @param list List the readers look events up in.
+/// @param count Number of reader threads.
+/// @param locked Whether the readers take the list's read lock instead of entering an epoch.
+/// @return Lookups per second across all readers, 0 on failure.
+static double run_readers(struct EventList* list, size_t count, bool locked) {
+  struct Reader readers[MAX_READERS];
+  atomic_store(&stop, false);
+  for (size_t i = 0; i < count; i++) {
+    readers[i] = (struct Reader){.list = list, .locked = locked, .seed = 2463534242u + (uint32_t)i};
+    if (pthread_create(&readers[i].thread, NULL, reader_loop, &readers[i]) != 0) {
+      fprintf(stderr, "Error creating reader thread\n");
+      atomic_store(&stop, true);
+      while (i-- > 0) pthread_join(readers[i].thread, NULL);
+      return 0;
+    }
+  }
+
+  struct timespec run = {RUN_MS / 1000, (RUN_MS % 1000) * 1000000L};
+  nanosleep(&run, NULL);
+  atomic_store(&stop, true);
+
+  unsigned long lookups = 0;
+  for (size_t i = 0; i < count; i++) {
+    pthread_join(readers[i].thread, NULL);
+    lookups += readers[i].lookups;
+  }
+  return (double)lookups * 1000.0 / RUN_MS;
+}
+
+int main(void) {
+  struct EventList* list = create_list();
+  if (list == NULL) return 1;
+  for (unsigned int i = 1; i <= NUM_EVENTS; i++) {
+    struct Event* event = alloc_event(list);
+    if (event == NULL) return 1;
+    // An event without seats, locks or reservations is all the index needs
+    memset(event, 0, sizeof(struct Event));
+    event->id = i;
+    if (append_to_list(list, event) != 0) return 1;
+  }
+
+  printf("%8s %20s %20s\n", "readers", "epoch lookups/s", "rwlock lookups/s");
+  for (size_t count = 1; count <= MAX_READERS; count *= 2) {
+    double epoch = run_readers(list, count, false);
+    double locked = run_readers(list, count, true);
+    if (epoch <= 0 || locked <= 0) return 1;
+    printf("%8zu %20.0f %20.0f\n", count, epoch, locked);
+  }
+
+  free_list(list);
+  epoch_drain();
+  return 0;
+}
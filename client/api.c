@@ -1,13 +1,23 @@
 #include "api.h"
+#include "common/codec.h"
 #include "common/constants.h"
+#include "common/io.h"
+#include "common/ring.h"
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 int req_pipe;                  //
 int resp_pipe;                 //current client specs
@@ -15,7 +25,142 @@ int received_session_id = -1;  //
 char const* resp_path;
 char const* req_path;
 
+// Where requests and responses go: the pipes, or the rings of shm_region if the server took it at setup
+static struct Channel requests = {.fd = -1};
+static struct Channel responses = {.fd = -1};
+static struct ShmRegion* shm_region = NULL;
+static char shm_name[SHM_NAME_SIZE];
+static bool prefer_shared_memory = false;
+
+#define SHM_CREATE_ATTEMPTS 4  // Names tried for the shared memory before giving up on it
+#define EVENT_MASK_WORDS 16  // The events a request touches are hashed into this many 64-bit words
+
+// Operation of a batch, with what finishing it needs
+struct BatchEntry {
+  uint8_t opcode;
+  int out_fd;
+};
+
+// Request sent and not yet finished, along with what finishing it needs
+struct InFlight {
+  uint8_t opcode;
+  uint64_t events[EVENT_MASK_WORDS];  // Events the request touches, a bit each (shared bits may be false alarms)
+  bool global;             // Whether the request touches every event (LIST, REPORT)
+  bool creates;            // Whether the request adds to the registry, whose order LIST and REPORT follow
+  int out_fd;              // File the response is printed to, for requests that print it
+  size_t num_seats;        // Seats asked for by BEST, and where to store them
+  size_t* xs;
+  size_t* ys;
+  unsigned int* hold_id;   // Where HOLD stores the id of the hold
+  struct BatchEntry* entries;  // Operations of a BATCH, in order (allocated, freed once finished)
+  size_t num_entries;
+  bool answered;
+  void* payload;           // Response, once answered (NULL if the server is gone)
+  size_t size;
+};
+
+// Requests in flight, tagged from first_tag up to next_tag, each kept at its tag modulo MAX_REQUESTS_IN_FLIGHT
+static struct InFlight window[MAX_REQUESTS_IN_FLIGHT];
+static uint32_t first_tag = 0;  // Oldest request not yet finished
+static uint32_t next_tag = 0;   // Tag of the next request
+static size_t pipeline_depth = 1;
+
+// Operations gathered and not yet sent, as a BATCH request
+static unsigned char batch_buffer[FRAME_HEADER_SIZE + MAX_BATCH_PAYLOAD];
+static struct Encoder batch;
+static struct InFlight batch_request;
+static size_t batch_size = 1;  // Operations gathered before the batch is sent, 1 to send each on its own
+
+void ems_prefer_shared_memory(void) { prefer_shared_memory = true; }
+
+/// Creates the shared memory to propose to the server, if a name of its own can be found for it.
+static void create_shared_memory(void) {
+  // A client that died before the server took its region leaves the name behind, so the pid alone could clash
+  // with a region of an earlier process of the same pid. Random bits make the name fresh on every attempt.
+  for (int attempt = 0; attempt < SHM_CREATE_ATTEMPTS && shm_region == NULL; attempt++) {
+    uint32_t salt;
+    if (getrandom(&salt, sizeof(salt), 0) != sizeof(salt)) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      salt = (uint32_t)now.tv_nsec ^ (uint32_t)attempt;
+    }
+    snprintf(shm_name, sizeof(shm_name), SHM_NAME_PREFIX "%d-%08x", (int)getpid(), (unsigned int)salt);
+    shm_region = shm_region_create(shm_name);
+  }
+}
+
+/// Gives up on the shared memory proposed to the server, if any.
+static void drop_shared_memory(void) {
+  if (shm_region == NULL) return;
+  shm_region_close(shm_region);
+  shm_unlink(shm_name);
+  shm_region = NULL;
+}
+
+/// Reads the answer of the server to the setup message: the session id, then whether it took the shared memory
+/// proposed, if any.
+/// @return 0 if a session id was received, 1 otherwise.
+static int read_setup_answer(void) {
+  read(resp_pipe, &received_session_id, sizeof(received_session_id));
+  if (shm_region != NULL) {
+    // The server has mapped the region by the time it answers, so its name is no longer needed
+    int accepted = 0;
+    if (read(resp_pipe, &accepted, sizeof(accepted)) != sizeof(accepted) || !accepted) {
+      drop_shared_memory();
+    } else {
+      shm_unlink(shm_name);
+      requests.ring = &shm_region->requests;
+      responses.ring = &shm_region->responses;
+      printf("Using shared memory for requests and responses\n");
+    }
+  }
+  if (received_session_id != -1) {
+      printf("End of file. Received session ID: %d\n", received_session_id);
+      return 0;
+  }
+  return 1;
+}
+
+/// Connects to a server through its seqpacket socket, whose connection then carries requests and responses alike.
+/// @param server_socket_path Path to the socket where the server is listening.
+/// @return 0 if the connection was established successfully, 1 otherwise.
+static int setup_socket(char const* server_socket_path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(server_socket_path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Server socket path too long\n");
+    return 1;
+  }
+  strcpy(address.sun_path, server_socket_path);
+
+  int socket_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (socket_fd == -1 || connect(socket_fd, (struct sockaddr*)&address, sizeof(address)) == -1) {
+    perror("Error connecting to server socket");
+    if (socket_fd != -1) close(socket_fd);
+    return 1;
+  }
+  if (prefer_shared_memory) {
+    create_shared_memory();
+  }
+
+  // The setup message is a record of its own: the name of the shared memory proposed, empty if none
+  const char* setup_request = shm_region != NULL ? shm_name : "";
+  if (write(socket_fd, setup_request, strlen(setup_request) + 1) == -1) {
+    perror("Error sending setup request to server");
+    close(socket_fd);
+    drop_shared_memory();
+    return 1;
+  }
+  req_pipe = resp_pipe = socket_fd;
+  requests = (struct Channel){.fd = socket_fd, .records = 1};
+  responses = (struct Channel){.fd = socket_fd, .records = 1};
+  return read_setup_answer();
+}
+
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path) {
+  // A server listening on a socket needs no pipes of the client's
+  struct stat server_info;
+  if (stat(server_pipe_path, &server_info) == 0 && S_ISSOCK(server_info.st_mode)) return setup_socket(server_pipe_path);
+
   //printf("resp_fd_main_client-\n");
   //TODO: create pipes and connect to the server
   // Create a request named pipe
@@ -31,20 +176,37 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
   }
   resp_path = resp_pipe_path;
   req_path = req_pipe_path;
+  // Shared memory is only proposed: without it, or if the server cannot map it, the pipes carry everything
+  if (prefer_shared_memory) {
+    create_shared_memory();
+  }
   // Open the server pipe
   int server_pipe = open(server_pipe_path, O_WRONLY);
   if (server_pipe == -1) {
       perror("Error opening server pipe");
+      drop_shared_memory();
       unlink(req_pipe_path);
       unlink(resp_pipe_path);
       return 1;
   }
   // Send a setup request to the server
   char setup_request[pipeBuffer];  // Adjust the buffer size as needed
-  snprintf(setup_request, pipeBuffer, "%s %s", req_pipe_path, resp_pipe_path);
+  // The server reads setup requests of pipeBuffer bytes, so a longer one would lose its last paths or the shared
+  // memory name and set the session up wrong
+  int setup_size =
+      snprintf(setup_request, pipeBuffer, "%s %s %s", req_pipe_path, resp_pipe_path, shm_region != NULL ? shm_name : "");
+  if (setup_size < 0 || setup_size >= pipeBuffer) {
+      fprintf(stderr, "Pipe paths too long for the setup request\n");
+      close(server_pipe);
+      drop_shared_memory();
+      unlink(req_pipe_path);
+      unlink(resp_pipe_path);
+      return 1;
+  }
   if (write(server_pipe, setup_request, sizeof(setup_request)) == -1) {
       perror("Error sending setup request to server");
       close(server_pipe);
+      drop_shared_memory();
       unlink(req_pipe_path);
       unlink(resp_pipe_path);
       return 1;
@@ -57,6 +219,7 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
       perror("Error opening pipes for communication");
       if (req_pipe != -1) close(req_pipe);
       if (resp_pipe != -1) close(resp_pipe);
+      drop_shared_memory();
       unlink(req_pipe_path);
       unlink(resp_pipe_path);
       return 1;
@@ -66,260 +229,658 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
   //  // TODO: Process the received data as needed
   //} 
   //ssize_t bytes_read = read(resp_pipe, &received_session_id, sizeof(received_session_id));
-  read(resp_pipe, &received_session_id, sizeof(received_session_id));
-  if (received_session_id != -1) {
-      printf("End of file. Received session ID: %d\n", received_session_id);
-      return 0;
-      // End of file, pipe closed by sender
-      // Handle accordingly
-  }
+  requests.fd = req_pipe;
+  responses.fd = resp_pipe;
   // TODO: Save session ID and any other necessary information
-  return 1;  // Success
+  return read_setup_answer();
 }
 
-int ems_quit(void) { 
-  //TODO: close pipes
-  printf("entered quit\n");
-
-  if (write(req_pipe, "2", 1) == -1) {
-      perror("Error sending create request to server");
-      return 1;
-  }
-  //falta ler na pipe resp a resposta do ems create para o cliente saber se obteve sucesso ou nao, se sim a funcao retorna 0
-  //se nao retorna o erro que deu 'event already exists' por ex, esse erro sera passado pela pipe claro
-  close(req_pipe);
-  close(resp_pipe);
-  // Unlink (delete) the named pipe
-  if (unlink(resp_path) == -1) {
-      perror("Error unlinking named pipe");
-      exit(EXIT_FAILURE);
+int ems_set_pipeline_depth(size_t depth) {
+  if (depth == 0 || depth > MAX_REQUESTS_IN_FLIGHT) {
+    fprintf(stderr, "Invalid pipeline depth\n");
+    return 1;
   }
-  // Unlink (delete) the named pipe
-  if (unlink(req_path) == -1) {
-      perror("Error unlinking named pipe");
-      exit(EXIT_FAILURE);
+  pipeline_depth = depth;
+  return 0;
+}
+
+int ems_set_batch_size(size_t size) {
+  if (size == 0 || size > MAX_BATCH_OPERATIONS) {
+    fprintf(stderr, "Invalid batch size\n");
+    return 1;
   }
+  batch_size = size;
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  //TODO: send create request to the server (through the request pipe) and wait for the response (through the response pipe)
-  printf("entered create\n");
-  char create_request[pipeBuffer];
-  snprintf(create_request, pipeBuffer, " 3 %u %zu %zu", event_id, num_rows, num_cols);
+/// Records that a request touches an event.
+/// @param request Request touching the event.
+/// @param event_id Id of the event.
+static void touch_event(struct InFlight* request, unsigned int event_id) {
+  size_t bit = event_id % (EVENT_MASK_WORDS * 64);
+  request->events[bit / 64] |= (uint64_t)1 << (bit % 64);
+}
 
-  if (write(req_pipe, create_request, sizeof(create_request)) == -1) {
-      perror("Error sending create request to server");
-      return 1;
+/// Gets the message printed when a request sent ahead of its response fails.
+/// @param opcode Opcode of the request.
+/// @return Message, without the newline.
+static const char* failure_message(uint8_t opcode) {
+  switch (opcode) {
+    case OP_CREATE:
+      return "Failed to create event";
+    case OP_RESERVE:
+    case OP_BEST:
+    case OP_TRANSACTION:
+      return "Failed to reserve seats";
+    case OP_SHOW:
+      return "Failed to show event";
+    case OP_LIST:
+      return "Failed to list events";
+    case OP_DELETE:
+      return "Failed to delete event";
+    case OP_CANCEL:
+      return "Failed to cancel reservation";
+    case OP_HOLD:
+      return "Failed to hold seats";
+    case OP_CONFIRM:
+      return "Failed to confirm hold";
+    case OP_REPORT:
+      return "Failed to report events";
+    case OP_AVAILABILITY:
+      return "Failed to get event availability";
+    default:
+      return "Request failed";
   }
+}
 
-  char bufferCreate[pipeBuffer];
-  int answer;
-  read(resp_pipe, bufferCreate, sizeof(answer));
-  sscanf(bufferCreate, "%d", &answer);
-  printf("answerCreate: %d\n", answer);
+/// Reads the next response, whichever request it answers.
+/// @note If the server is gone, every request in flight is taken as answered with no response, so nothing waits
+/// on it forever.
+/// @return 0 if a response was read, 1 otherwise.
+static int receive_response(void) {
+  struct FrameHeader header;
+  void* payload;
+  if (read_frame_alloc(&responses, &header, &payload, UINT32_MAX) != 0) {
+    fprintf(stderr, "Error reading response from server\n");
+    for (uint32_t tag = first_tag; tag != next_tag; tag++) {
+      struct InFlight* request = &window[tag % MAX_REQUESTS_IN_FLIGHT];
+      if (!request->answered) {
+        request->answered = true;
+        request->payload = NULL;
+      }
+    }
+    return 1;
+  }
 
-  if (answer == 1)
+  struct InFlight* request = &window[header.tag % MAX_REQUESTS_IN_FLIGHT];
+  if (header.tag - first_tag >= next_tag - first_tag || request->answered || request->opcode != header.opcode) {
+    fprintf(stderr, "Invalid response from server\n");
+    free(payload);
     return 1;
+  }
 
+  request->answered = true;
+  request->payload = payload;
+  request->size = header.size;
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  //TODO: send reserve request to the server (through the request pipe) and wait for the response (through the response pipe)
-  printf("entered reserve\n");
-  //for (size_t i = 0; i < MAX_RESERVATION_SIZE; ++i) {
-  //  printf("xs[%zu], ys[%zu]\n", xs[i], ys[i]);
-  //}
-
-  // Prepare the reserve request string
-  char reserve_request[pipeBuffer];
-  int offset = snprintf(reserve_request, pipeBuffer, " 4 %u %zu", event_id, num_seats);  
-  // Append xs and ys to the request string
-  for (size_t i = 0; i < num_seats; ++i) {
-   offset += snprintf(reserve_request + offset, pipeBuffer - offset, " %zu %zu", xs[i], ys[i]);
-  }
-    printf("Reserve Request: %s\n", reserve_request);
-
-  if (write(req_pipe, reserve_request, (size_t)offset) == -1) {
-      perror("Error sending reserve request to server");
-      return 1;
+/// Checks whether a request must wait for one in flight before being sent, because the server could run them in
+/// either order: they touch a common event, either touches every event, or both create an event (events are listed
+/// in creation order).
+/// @param request Request to be sent.
+/// @return Whether an unanswered request in flight conflicts with it.
+static bool conflicts(const struct InFlight* request) {
+  for (uint32_t tag = first_tag; tag != next_tag; tag++) {
+    const struct InFlight* other = &window[tag % MAX_REQUESTS_IN_FLIGHT];
+    if (other->answered) continue;
+    if (request->global || other->global || (request->creates && other->creates)) return true;
+    for (size_t i = 0; i < EVENT_MASK_WORDS; i++) {
+      if (request->events[i] & other->events[i]) return true;
+    }
   }
-  char bufferReSERVA[pipeBuffer];
-  int answer;
-  read(resp_pipe, bufferReSERVA, sizeof(answer));
-  printf("buffer reserve fim:\n%s\n", bufferReSERVA);
-  //if (answer == 0)
-  //  return 0;
-  //return 1;
-  return 0;
+  return false;
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  //TODO: send show request to the server (through the request pipe) and wait for the response (through the response pipe)
-  printf("entered show\n");
-  char show_request[pipeBuffer];
-  snprintf(show_request, pipeBuffer, " 5 %u", event_id);
+/// Prints the seats of an event, a row per line.
+/// @param out_fd File descriptor to print to.
+/// @param seats Seats of the event, as uint32_t (possibly unaligned).
+/// @param num_rows Number of rows.
+/// @param num_cols Number of columns.
+/// @return 0 if the seats were printed successfully, 1 otherwise.
+static int print_seats(int out_fd, const unsigned char* seats, size_t num_rows, size_t num_cols) {
+  // Each seat takes at most 10 digits and a separator
+  char* buffer = malloc(num_rows * num_cols * 11 + 1);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for seats\n");
+    return 1;
+  }
 
-  if (write(req_pipe, show_request, sizeof(show_request)) == -1) {
-      perror("Error sending show request to server");
-      return 1;
+  size_t offset = 0;
+  for (size_t i = 0; i < num_rows * num_cols; i++) {
+    uint32_t seat;
+    memcpy(&seat, seats + i * sizeof(uint32_t), sizeof(uint32_t));
+    offset += (size_t)sprintf(buffer + offset, "%u%c", seat, (i + 1) % num_cols == 0 ? '\n' : ' ');
   }
 
-  memset(show_request, 0, sizeof(show_request));
-  if (read(resp_pipe, show_request, sizeof(show_request)) == -1) {
-      perror("Error sending show request to server");
-      return 1;
+  int result = print_str(out_fd, buffer);
+  free(buffer);
+  return result;
+}
+
+/// Prints the seats of a SHOW response.
+/// @param out_fd File descriptor to print to.
+/// @param dec Decoder over the response, past its status.
+/// @return 0 if the seats were printed successfully, 1 otherwise.
+static int print_show(int out_fd, struct Decoder* dec) {
+  uint64_t num_rows, num_cols;
+  const unsigned char* seats = NULL;
+  if (decode_u64(dec, &num_rows) == 0 && decode_u64(dec, &num_cols) == 0 &&
+      (num_cols == 0 || num_rows <= SIZE_MAX / sizeof(uint32_t) / num_cols)) {
+    seats = decode_bytes(dec, num_rows * num_cols * sizeof(uint32_t));
+  }
+  if (seats == NULL) {
+    fprintf(stderr, "Invalid show response from server\n");
+    return 1;
   }
-  size_t size = 0;
-  sscanf(show_request, "%zu", &size);
-  printf("anSIZEEEEEr: %zu\n", size);
-  char show_buffer[500];
-  //printf("ola syze: %zu\n",strlen(show_buffer));
-  memset(show_buffer, 0, sizeof(show_buffer));
-  
-  if (read(resp_pipe, show_buffer, sizeof(show_buffer)) == -1) {
-      perror("Error sending show request to server");
+
+  int result = print_seats(out_fd, seats, num_rows, num_cols);
+  if (result != 0) perror("Error writing to file descriptor");
+  return result;
+}
+
+/// Prints the events of a LIST response.
+/// @param out_fd File descriptor to print to.
+/// @param dec Decoder over the response, past its status.
+/// @return 0 if the events were printed successfully, 1 otherwise.
+static int print_list(int out_fd, struct Decoder* dec) {
+  uint64_t num_events;
+  if (decode_u64(dec, &num_events) != 0) {
+    fprintf(stderr, "Invalid list response from server\n");
+    return 1;
+  }
+
+  int result = num_events == 0 ? print_str(out_fd, "No events\n") : 0;
+  for (size_t i = 0; result == 0 && i < num_events; i++) {
+    uint32_t event_id;
+    if (decode_u32(dec, &event_id) != 0) {
+      fprintf(stderr, "Invalid list response from server\n");
       return 1;
+    }
+    result = print_str(out_fd, "Event: ") || print_uint(out_fd, event_id) || print_str(out_fd, "\n");
   }
 
-  int answer;
-  memcpy(&answer, show_buffer, sizeof(int));
-  printf("answer: %d\n", answer);
+  if (result != 0) perror("Error writing to file descriptor");
+  return result;
+}
 
-  if (answer == 1){
+/// Prints the events and seats of a REPORT response.
+/// @param out_fd File descriptor to print to.
+/// @param dec Decoder over the response, past its status.
+/// @return 0 if the report was printed successfully, 1 otherwise.
+static int print_report(int out_fd, struct Decoder* dec) {
+  uint64_t num_events;
+  if (decode_u64(dec, &num_events) != 0) {
+    fprintf(stderr, "Invalid report response from server\n");
     return 1;
   }
 
-  size_t num_rows, num_cols;
-  memcpy(&num_rows, show_buffer + sizeof(int), sizeof(size_t));
-  memcpy(&num_cols, show_buffer + sizeof(int) + sizeof(size_t), sizeof(size_t));
-  printf("rows/cols: %zu, %zu\n", num_rows, num_cols);
+  int result = num_events == 0 ? print_str(out_fd, "No events\n") : 0;
+  for (size_t e = 0; result == 0 && e < num_events; e++) {
+    uint32_t event_id;
+    uint64_t num_rows, num_cols;
+    const unsigned char* seats = NULL;
+    if (decode_u32(dec, &event_id) == 0 && decode_u64(dec, &num_rows) == 0 && decode_u64(dec, &num_cols) == 0 &&
+        (num_cols == 0 || num_rows <= SIZE_MAX / sizeof(uint32_t) / num_cols)) {
+      seats = decode_bytes(dec, num_rows * num_cols * sizeof(uint32_t));
+    }
+    if (seats == NULL) {
+      fprintf(stderr, "Invalid report response from server\n");
+      return 1;
+    }
 
+    result = print_str(out_fd, "Event: ") || print_uint(out_fd, event_id) || print_str(out_fd, "\n") ||
+             print_seats(out_fd, seats, num_rows, num_cols);
+  }
 
-  // Aloca espaço para o array de IDs do evento
-  unsigned int *seats = (unsigned int *)malloc(num_rows * num_cols * sizeof(unsigned int));
-  if (seats == NULL) {
-    fprintf(stderr, "Erro na alocação de memória\n");
+  if (result != 0) perror("Error writing to file descriptor");
+  return result;
+}
+
+/// Prints the free seat counts of an AVAILABILITY response.
+/// @param out_fd File descriptor to print to.
+/// @param dec Decoder over the response, past its status.
+/// @return 0 if the counts were printed successfully, 1 otherwise.
+static int print_availability(int out_fd, struct Decoder* dec) {
+  uint64_t free_count, num_rows;
+  if (decode_u64(dec, &free_count) != 0 || decode_u64(dec, &num_rows) != 0) {
+    fprintf(stderr, "Invalid availability response from server\n");
     return 1;
   }
-  //int size2 = sizeof(int) + (2* sizeof(size_t)) + num_rows * num_cols * sizeof(unsigned int);
-  //for (size_t j = 0; j < (size2); j++) {
-  //  //printf("N:%u \n", show_buffer[j]);
-  //}
 
-  // Lê os IDs do evento
-  size_t bufferSize = num_rows * num_cols * sizeof(unsigned int) + (num_rows) * (num_cols -1) * strlen(" ") + (num_rows) * strlen("\n") ; 
-  char showOutputBuffer[bufferSize];
-  memset(showOutputBuffer, 0, sizeof(showOutputBuffer));
+  char line[32];
+  snprintf(line, sizeof(line), "Free seats: %zu\n", (size_t)free_count);
+  int result = print_str(out_fd, line);
+  for (size_t row = 0; result == 0 && row < num_rows; row++) {
+    uint64_t row_free;
+    if (decode_u64(dec, &row_free) != 0) {
+      fprintf(stderr, "Invalid availability response from server\n");
+      return 1;
+    }
+    snprintf(line, sizeof(line), "%zu%s", (size_t)row_free, row + 1 < num_rows ? " " : "\n");
+    result = print_str(out_fd, line);
+  }
+
+  if (result != 0) perror("Error writing to file descriptor");
+  return result;
+}
 
-  size_t offset = 0;
+/// Takes the seats chosen by the server from a BEST response.
+/// @param request Request being finished, holding where to store the seats.
+/// @param dec Decoder over the response, past its status.
+/// @return 0 if the seats were taken, 1 otherwise.
+static int take_best(const struct InFlight* request, struct Decoder* dec) {
+  uint64_t num_reserved;
+  int result = decode_u64(dec, &num_reserved) != 0 || num_reserved != request->num_seats;
+  for (size_t i = 0; result == 0 && i < num_reserved; i++) {
+    uint64_t row, col;
+    result = decode_u64(dec, &row) != 0 || decode_u64(dec, &col) != 0;
+    request->xs[i] = row;
+    request->ys[i] = col;
+  }
+  if (result != 0) fprintf(stderr, "Invalid best seats response from server\n");
+  return result;
+}
 
-  for (size_t i = 0; i < num_rows * num_cols; ++i) {
-    memcpy(&seats[i], show_buffer + sizeof(int) + sizeof(size_t) + sizeof(size_t) + (i * sizeof(unsigned int)), sizeof(unsigned int));
-    //printf("seats: %u\n",seats[i] );
-  }
-  for (size_t i = 1; i <= num_rows; i++) {
-    for (size_t j = 1; j <= num_cols; j++) {
-      offset += sprintf(showOutputBuffer + offset, "%u", seats[(i - 1) * num_cols + (j - 1)]);
-      //printf("seats 218: %u\n",seats[(i - 1) * num_cols + (j - 1)] );
-      if (j < num_cols){
-        strcat(showOutputBuffer + offset, " ");
-        offset+= strlen(" ");
-      }
-      else{
-        strcat(showOutputBuffer + offset, "\n");
-        offset+= strlen("\n");
+/// Finishes an operation from its response: checks its status and prints or stores whatever follows.
+/// @param request Request of the operation.
+/// @param dec Decoder over the response.
+/// @return 0 if the operation succeeded, 1 otherwise.
+static int finish_operation(const struct InFlight* request, struct Decoder* dec) {
+  int32_t status;
+  if (decode_i32(dec, &status) != 0 || status != 0) return 1;
+
+  switch (request->opcode) {
+    case OP_SHOW:
+      return print_show(request->out_fd, dec);
+    case OP_LIST:
+      return print_list(request->out_fd, dec);
+    case OP_REPORT:
+      return print_report(request->out_fd, dec);
+    case OP_AVAILABILITY:
+      return print_availability(request->out_fd, dec);
+    case OP_BEST:
+      return take_best(request, dec);
+    case OP_HOLD:
+      if (decode_u32(dec, request->hold_id) != 0) {
+        fprintf(stderr, "Invalid hold response from server\n");
+        return 1;
       }
+      return 0;
+    default:
+      return 0;
+  }
+}
+
+/// Finishes the operations of a batch from its response, reporting those that failed.
+/// @note If the batch as a whole failed, every operation is reported as failed.
+/// @param request Request of the batch.
+/// @return 0 if every operation succeeded, 1 otherwise.
+static int finish_batch(const struct InFlight* request) {
+  struct Decoder dec;
+  int32_t status;
+  uint64_t count;
+  bool valid = request->payload != NULL;
+  if (valid) {
+    decode_begin(&dec, request->payload, request->size);
+    valid = decode_i32(&dec, &status) == 0 && status == 0 && decode_u64(&dec, &count) == 0 &&
+            count == request->num_entries;
+  }
+
+  int result = 0;
+  for (size_t i = 0; i < request->num_entries; i++) {
+    struct InFlight operation = {.opcode = request->entries[i].opcode, .out_fd = request->entries[i].out_fd};
+    struct FrameHeader header;
+    const void* payload;
+    valid = valid && decode_frame(&dec, &header, &payload) == 0 && header.opcode == operation.opcode;
+
+    struct Decoder response;
+    if (valid) decode_begin(&response, payload, header.size);
+    if (!valid || finish_operation(&operation, &response) != 0) {
+      fprintf(stderr, "%s\n", failure_message(operation.opcode));
+      result = 1;
     }
   }
-  printf("Buffer sHOW:\n%s\n", showOutputBuffer);
+  return result;
+}
 
-  if (write(out_fd, showOutputBuffer, offset) == -1) {
-    perror("Error sending list request to server");
-    free(seats);
-    return 1;
+/// Finishes the oldest request in flight, waiting for its response if need be (responses to other requests read
+/// meanwhile are kept for later).
+/// @return 0 if the request succeeded, 1 otherwise.
+static int finish_oldest(void) {
+  struct InFlight* request = &window[first_tag % MAX_REQUESTS_IN_FLIGHT];
+  while (!request->answered) receive_response();
+  first_tag++;
+
+  int result = 1;
+  if (request->opcode == OP_BATCH) {
+    result = finish_batch(request);
+  } else if (request->payload != NULL) {
+    struct Decoder dec;
+    decode_begin(&dec, request->payload, request->size);
+    result = finish_operation(request, &dec);
   }
 
-  free(seats);
-  
-  return 0;
+  free(request->entries);
+  request->entries = NULL;
+  free(request->payload);
+  request->payload = NULL;
+  return result;
 }
 
-int ems_list_events(int out_fd) {
-  //TODO: send list request to the server (through the request pipe) and wait for the response (through the response pipe)
-  printf("entered list\n");
-  char show_request[pipeBuffer];
-  snprintf(show_request, pipeBuffer, " 6");
+/// Finishes the oldest request in flight, reporting its failure, since its caller is no longer waiting on it.
+/// @return 0 if the request succeeded, 1 otherwise.
+static int finish_oldest_reported(void) {
+  uint8_t opcode = window[first_tag % MAX_REQUESTS_IN_FLIGHT].opcode;
+  int result = finish_oldest();
+  // The operations of a batch were already reported one by one
+  if (result != 0 && opcode != OP_BATCH) fprintf(stderr, "%s\n", failure_message(opcode));
+  return result;
+}
 
-  if (write(req_pipe, show_request, sizeof(show_request)) == -1) {
-      perror("Error sending show request to server");
-      return 1;
+/// Sends a request, once the window has room for it and no request in flight conflicts with it.
+/// @param enc Encoder holding the request.
+/// @param request What the request touches and what finishing it needs.
+/// @param wait Whether the caller needs the result of the request, in which case everything before it is finished
+/// too, so that anything printed comes out in order.
+/// @return With wait, or a pipeline depth of 1, 0 if the request succeeded and 1 otherwise; otherwise 0 if the
+/// request was sent and 1 otherwise.
+static int send_request(struct Encoder* enc, struct InFlight* request, bool wait) {
+  while (next_tag - first_tag >= pipeline_depth) finish_oldest_reported();
+  while (conflicts(request)) {
+    if (receive_response() != 0) break;
   }
 
-  char list_buffer[pipeBuffer];
-  memset(list_buffer, 0, sizeof(list_buffer));
-  
-  if (read(resp_pipe, list_buffer, sizeof(list_buffer)) == -1) {
-      perror("Error sending show request to server");
-      return 1;
+  if (send_frame(&requests, enc, next_tag) != 0) {
+    perror("Error sending request to server");
+    free(request->entries);
+    return 1;
+  }
+  request->answered = false;
+  request->payload = NULL;
+  window[next_tag % MAX_REQUESTS_IN_FLIGHT] = *request;
+  next_tag++;
+
+  if (!wait && pipeline_depth > 1) return 0;
+  while (next_tag - first_tag > 1) finish_oldest_reported();
+  return finish_oldest();
+}
+
+/// Sends the operations gathered so far as a batch, if any.
+/// @return 0 if the batch was sent (or there was none), 1 otherwise.
+static int send_batch(void) {
+  if (batch_request.num_entries == 0) return 0;
+
+  // The count was left blank when the batch was started
+  uint64_t count = batch_request.num_entries;
+  memcpy(batch.data + FRAME_HEADER_SIZE, &count, sizeof(count));
+  int result = send_request(&batch, &batch_request, false);
+  batch_request = (struct InFlight){.opcode = OP_BATCH};
+  return result;
+}
+
+/// Adds an operation to the batch being gathered, sending the batch first if the operation does not fit.
+/// @param enc Encoder holding the request of the operation.
+/// @param request What the operation touches and what finishing it needs.
+/// @return 0 if the operation was added, 1 otherwise.
+static int add_to_batch(struct Encoder* enc, struct InFlight* request) {
+  if (batch_request.num_entries > 0 && (batch_request.num_entries == batch_size ||
+                                        enc->size > batch.capacity - batch.size)) {
+    if (send_batch() != 0) return 1;
   }
 
-  int answer;
-  memcpy(&answer, list_buffer, sizeof(int));
-  printf("answer: %d\n", answer);
+  if (batch_request.num_entries == 0) {
+    batch_request.opcode = OP_BATCH;
+    batch_request.entries = malloc(batch_size * sizeof(struct BatchEntry));
+    if (batch_request.entries == NULL) {
+      fprintf(stderr, "Error allocating memory for batch\n");
+      return 1;
+    }
+    encode_begin(&batch, batch_buffer, sizeof(batch_buffer), OP_BATCH);
+    encode_u64(&batch, 0);
+  }
 
-  if (answer == 1){
+  encode_frame(&batch, enc, 0);
+  if (batch.overflow) {
+    fprintf(stderr, "Request too long for a batch\n");
     return 1;
   }
 
-  size_t num_events;
-  memcpy(&num_events, list_buffer + sizeof(int), sizeof(size_t));
-  printf("answer: %zu\n", num_events);
+  batch_request.entries[batch_request.num_entries++] = (struct BatchEntry){request->opcode, request->out_fd};
+  batch_request.global = batch_request.global || request->global;
+  batch_request.creates = batch_request.creates || request->creates;
+  for (size_t i = 0; i < EVENT_MASK_WORDS; i++) {
+    batch_request.events[i] |= request->events[i];
+  }
+  return 0;
+}
+
+/// Sends a request, or adds it to the batch being gathered when batching and the caller does not need its result.
+/// @param enc Encoder holding the request.
+/// @param request What the request touches and what finishing it needs; its opcode is taken from enc.
+/// @param wait Whether the caller needs the result of the request.
+/// @return Like send_request; 0 if the request was added to the batch.
+static int submit(struct Encoder* enc, struct InFlight* request, bool wait) {
+  request->opcode = encoded_opcode(enc);
+  if (!wait && batch_size > 1) return add_to_batch(enc, request);
+
+  // Whatever was gathered before the request goes first
+  if (send_batch() != 0) return 1;
+  return send_request(enc, request, wait);
+}
 
+int ems_flush(void) {
+  int result = send_batch();
+  while (first_tag != next_tag) result |= finish_oldest_reported();
+  return result;
+}
 
-  // Aloca espaço para o array de IDs do evento
-  unsigned int *ids = (unsigned int *)malloc(num_events * sizeof(unsigned int));
-  if (ids == NULL) {
-    fprintf(stderr, "Erro na alocação de memória\n");
-    return 1;
+int ems_quit(void) { 
+  //TODO: close pipes
+  printf("entered quit\n");
+  ems_flush();
+
+  unsigned char request[FRAME_HEADER_SIZE];
+  struct Encoder enc;
+  encode_begin(&enc, request, sizeof(request), OP_QUIT);
+  if (send_frame(&requests, &enc, next_tag) != 0) {
+      perror("Error sending quit request to server");
+      return 1;
   }
+  close(req_pipe);
+  if (resp_pipe != req_pipe) close(resp_pipe);
+  if (shm_region != NULL) shm_region_close(shm_region);
+  // A session set up through a socket has no pipes to remove
+  if (req_path == NULL) return 0;
+  // Unlink (delete) the named pipe
+  if (unlink(resp_path) == -1) {
+      perror("Error unlinking named pipe");
+      exit(EXIT_FAILURE);
+  }
+  // Unlink (delete) the named pipe
+  if (unlink(req_path) == -1) {
+      perror("Error unlinking named pipe");
+      exit(EXIT_FAILURE);
+  }
+  return 0;
+}
 
-  // Lê os IDs do evento
-  size_t bufferSize = num_events * sizeof(unsigned int) + num_events * strlen("Event: \n"); 
-  char listOutputBuffer[bufferSize];
+/// Appends a list of seats to a request: their number, then the row and column of each one.
+/// @param enc Encoder to append to.
+/// @param num_seats Number of seats.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void encode_seats(struct Encoder* enc, size_t num_seats, size_t* xs, size_t* ys) {
+  encode_u64(enc, num_seats);
+  for (size_t i = 0; i < num_seats; i++) {
+    encode_u64(enc, xs[i]);
+    encode_u64(enc, ys[i]);
+  }
+}
 
-  size_t offset = 0;
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(uint32_t) + 2 * sizeof(uint64_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_CREATE);
+  encode_u32(&enc, event_id);
+  encode_u64(&enc, num_rows);
+  encode_u64(&enc, num_cols);
+
+  struct InFlight request = {.creates = true};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
 
-  // Loop para cada evento
-  for (size_t i = 0; i < num_events; ++i) {
-    memcpy(&ids[i], list_buffer + sizeof(int) + sizeof(size_t) + (i * sizeof(unsigned int)), sizeof(unsigned int));
+int ems_delete(unsigned int event_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(uint32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_DELETE);
+  encode_u32(&enc, event_id);
+
+  struct InFlight request = {0};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
+
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  unsigned char buffer[FRAME_HEADER_SIZE + MAX_REQUEST_PAYLOAD];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_RESERVE);
+  encode_u32(&enc, event_id);
+  encode_seats(&enc, num_seats, xs, ys);
+
+  struct InFlight request = {0};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
 
-    // Copiar "Event: " para o buffer de saída
-    strcpy(listOutputBuffer + offset, "Event: ");
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(uint32_t) + sizeof(uint64_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_BEST);
+  encode_u32(&enc, event_id);
+  encode_u64(&enc, num_seats);
 
-    // Atualizar o deslocamento
-    offset += strlen("Event: ");
+  struct InFlight request = {.num_seats = num_seats, .xs = xs, .ys = ys};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, true);
+}
 
-    // Converter o ID do evento para uma string e copiar para o buffer de saída
-    offset += sprintf(listOutputBuffer + offset, "%u", ids[i]);
+int ems_reserve_transaction(size_t num_groups, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys) {
+  unsigned char buffer[FRAME_HEADER_SIZE + MAX_REQUEST_PAYLOAD];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_TRANSACTION);
+  encode_u64(&enc, num_groups);
+  size_t seat = 0;
+  for (size_t g = 0; g < num_groups; g++) {
+    encode_u32(&enc, event_ids[g]);
+    encode_seats(&enc, num_seats[g], xs + seat, ys + seat);
+    seat += num_seats[g];
+  }
 
-    // Adicionar uma quebra de linha
-    strcpy(listOutputBuffer + offset, "\n");
+  // The whole request must fit in a single message
+  if (enc.overflow) {
+    fprintf(stderr, "Transaction request too long\n");
+    return 1;
+  }
 
-    // Atualizar o deslocamento para a próxima linha
-    offset += 1;
+  struct InFlight request = {0};
+  for (size_t g = 0; g < num_groups; g++) {
+    touch_event(&request, event_ids[g]);
   }
+  return submit(&enc, &request, false);
+}
+
+int ems_cancel(unsigned int event_id, unsigned int reservation_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + 2 * sizeof(uint32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_CANCEL);
+  encode_u32(&enc, event_id);
+  encode_u32(&enc, reservation_id);
 
-  printf("Buffer list: %s\n", listOutputBuffer);
+  struct InFlight request = {0};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
 
-  if (write(out_fd, listOutputBuffer, offset) == -1) {
-    perror("Error sending list request to server");
-    free(ids);
+int ems_hold(unsigned int event_id, unsigned int ttl_ms, size_t num_seats, size_t* xs, size_t* ys,
+             unsigned int* hold_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + MAX_REQUEST_PAYLOAD];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_HOLD);
+  encode_u32(&enc, event_id);
+  encode_u32(&enc, ttl_ms);
+  encode_seats(&enc, num_seats, xs, ys);
+
+  // The whole request must fit in a single message
+  if (enc.overflow) {
+    fprintf(stderr, "Hold request too long\n");
     return 1;
   }
 
-  free(ids);
+  struct InFlight request = {.hold_id = hold_id};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, true);
+}
 
-  return 0;
+int ems_confirm(unsigned int event_id, unsigned int hold_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + 2 * sizeof(uint32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_CONFIRM);
+  encode_u32(&enc, event_id);
+  encode_u32(&enc, hold_id);
+
+  struct InFlight request = {0};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
+
+int ems_show(int out_fd, unsigned int event_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(uint32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_SHOW);
+  encode_u32(&enc, event_id);
+
+  struct InFlight request = {.out_fd = out_fd};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
+}
+
+int ems_list_events(int out_fd) {
+  unsigned char buffer[FRAME_HEADER_SIZE];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_LIST);
+
+  struct InFlight request = {.global = true, .out_fd = out_fd};
+  return submit(&enc, &request, false);
+}
+
+int ems_report(int out_fd) {
+  unsigned char buffer[FRAME_HEADER_SIZE];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_REPORT);
+
+  struct InFlight request = {.global = true, .out_fd = out_fd};
+  return submit(&enc, &request, false);
+}
+
+int ems_availability(int out_fd, unsigned int event_id) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(uint32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), OP_AVAILABILITY);
+  encode_u32(&enc, event_id);
+
+  struct InFlight request = {.out_fd = out_fd};
+  touch_event(&request, event_id);
+  return submit(&enc, &request, false);
 }
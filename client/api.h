@@ -3,10 +3,16 @@
 
 #include <stddef.h>
 
+/// Asks for the next ems_setup to propose shared memory rings to the server instead of the pipes, for a client on
+/// the same host. The pipes are still used if the server does not take them.
+void ems_prefer_shared_memory(void);
+
 /// Connects to an EMS server.
+/// @note If server_pipe_path is the server's session socket, requests and responses travel over the connection and
+/// no pipes are created.
 /// @param req_pipe_path Path to the name pipe to be created for requests.
 /// @param resp_pipe_path Path to the name pipe to be created for responses.
-/// @param server_pipe_path Path to the name pipe where the server is listening.
+/// @param server_pipe_path Path to the name pipe (or socket) where the server is listening.
 /// @return 0 if the connection was established successfully, 1 otherwise.
 int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const* server_pipe_path);
 
@@ -14,6 +20,27 @@ int ems_setup(char const* req_pipe_path, char const* resp_pipe_path, char const*
 /// @return 0 in case of success, 1 otherwise.
 int ems_quit(void);
 
+/// Sets how many requests may be in flight at once.
+/// @note With a depth of 1 (the default) each call waits for its response. With more, calls other than
+/// ems_reserve_best and ems_hold return as soon as their request is sent: responses are printed, and failures
+/// reported on stderr, once every earlier request has finished. Requests touching a common event still reach the
+/// server one after the other.
+/// @param depth Number of requests, at most MAX_REQUESTS_IN_FLIGHT.
+/// @return 0 if the depth was set, 1 otherwise.
+int ems_set_pipeline_depth(size_t depth);
+
+/// Sets how many operations are gathered into a single BATCH request.
+/// @note With a size of 1 (the default) each operation is its own request. With more, calls that return before
+/// their response (see ems_set_pipeline_depth) only add their operation to the batch, which is sent once full,
+/// before a call that waits for its result, or on ems_flush. The server runs a batch in order.
+/// @param size Number of operations, at most MAX_BATCH_OPERATIONS.
+/// @return 0 if the size was set, 1 otherwise.
+int ems_set_batch_size(size_t size);
+
+/// Sends the batch being gathered, if any, and waits for every request in flight to finish.
+/// @return 0 if every request succeeded, 1 otherwise.
+int ems_flush(void);
+
 /// Creates a new event with the given id and dimensions.
 /// @param event_id Id of the event to be created.
 /// @param num_rows Number of rows of the event to be created.
@@ -21,6 +48,11 @@ int ems_quit(void);
 /// @return 0 if the event was created successfully, 1 otherwise.
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
+/// Deletes the event with the given id.
+/// @param event_id Id of the event to be deleted.
+/// @return 0 if the event was deleted successfully, 1 otherwise.
+int ems_delete(unsigned int event_id);
+
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
@@ -29,15 +61,66 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
 
+/// Reserves the best available seats of the given event, chosen by the server.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array to store the rows of the reserved seats in.
+/// @param ys Array to store the columns of the reserved seats in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys);
+
+/// Creates a reservation on each of several events, all or nothing.
+/// @param num_groups Number of events.
+/// @param event_ids Array of ids of the events.
+/// @param num_seats Array of the number of seats to reserve on each event.
+/// @param xs Array of rows of the seats to reserve, the seats of each event following the previous event's.
+/// @param ys Array of columns of the seats to reserve, in the same order as xs.
+/// @return 0 if every reservation was created, 1 otherwise.
+int ems_reserve_transaction(size_t num_groups, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys);
+
+/// Cancels a reservation of the given event.
+/// @param event_id Id of the event the reservation belongs to.
+/// @param reservation_id Id of the reservation to be cancelled.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(unsigned int event_id, unsigned int reservation_id);
+
+/// Holds seats of the given event for a limited time, after which the server frees them unless confirmed.
+/// @param event_id Id of the event to hold the seats of.
+/// @param ttl_ms Time the seats are held for, in milliseconds.
+/// @param num_seats Number of seats to hold.
+/// @param xs Array of rows of the seats to hold.
+/// @param ys Array of columns of the seats to hold.
+/// @param hold_id Pointer to store the id of the hold in.
+/// @return 0 if the seats were held successfully, 1 otherwise.
+int ems_hold(unsigned int event_id, unsigned int ttl_ms, size_t num_seats, size_t* xs, size_t* ys,
+             unsigned int* hold_id);
+
+/// Turns a hold into a reservation that no longer expires.
+/// @param event_id Id of the event the hold belongs to.
+/// @param hold_id Id of the hold to be confirmed.
+/// @return 0 if the hold was confirmed successfully, 1 otherwise.
+int ems_confirm(unsigned int event_id, unsigned int hold_id);
+
 /// Prints the given event to the given file.
 /// @param out_fd File descriptor to print the event to.
 /// @param event_id Id of the event to print.
 /// @return 0 if the event was printed successfully, 1 otherwise.
 int ems_show(int out_fd, unsigned int event_id);
 
+/// Prints the number of free seats of the given event to the given file, in total and per row.
+/// @param out_fd File descriptor to print the counts to.
+/// @param event_id Id of the event.
+/// @return 0 if the counts were printed successfully, 1 otherwise.
+int ems_availability(int out_fd, unsigned int event_id);
+
 /// Prints all the events to the given file.
 /// @param out_fd File descriptor to print the events to.
 /// @return 0 if the events were printed successfully, 1 otherwise.
 int ems_list_events(int out_fd);
 
+/// Prints every event with its seats to the given file, all as of a single moment.
+/// @param out_fd File descriptor to print the report to.
+/// @return 0 if the report was printed successfully, 1 otherwise.
+int ems_report(int out_fd);
+
 #endif  // CLIENT_API_H
@@ -4,21 +4,36 @@
 #include <unistd.h>
 
 #include "api.h"
+#include "common/io.h"
 #include "common/constants.h"
 #include "parser.h"
 
 int main(int argc, char* argv[]) {
-  if (argc < 5) {
-    fprintf(stderr, "Usage: %s <request pipe path> <response pipe path> <server pipe path> <.jobs file path>\n",
+  if (argc < 5 || argc > 6) {
+    fprintf(stderr,
+            "Usage: %s <request pipe path> <response pipe path> <server pipe or socket path> <.jobs file path> [pipe|shm]\n",
             argv[0]);
     return 1;
   }
 
+  if (argc == 6) {
+    if (strcmp(argv[5], "shm") == 0) {
+      ems_prefer_shared_memory();
+    } else if (strcmp(argv[5], "pipe") != 0) {
+      fprintf(stderr, "Invalid transport\n");
+      return 1;
+    }
+  }
+
   if (ems_setup(argv[1], argv[2], argv[3])) {
     fprintf(stderr, "Failed to set up EMS\n");
     return 1;
   }
-  
+
+  // Keeps the pipe full: each command costs the server's time rather than a round trip. Commands between WAITs
+  // also travel in batches, so a message carries many of them
+  if (ems_set_pipeline_depth(MAX_REQUESTS_IN_FLIGHT) || ems_set_batch_size(MAX_BATCH_OPERATIONS)) return 1;
+
   const char* dot = strrchr(argv[4], '.');
   if (dot == NULL || dot == argv[4] || strlen(dot) != 5 || strcmp(dot, ".jobs") ||
       strlen(argv[4]) > MAX_JOB_FILE_NAME_SIZE) {
@@ -69,6 +84,82 @@ int main(int argc, char* argv[]) {
         if (ems_reserve(event_id, num_coords, xs, ys)) fprintf(stderr, "Failed to reserve seats\n");
         break;
 
+      case CMD_BEST:
+        if (parse_best(in_fd, &event_id, &num_coords) != 0 || num_coords == 0 || num_coords > MAX_RESERVATION_SIZE) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_reserve_best(event_id, num_coords, xs, ys)) {
+          fprintf(stderr, "Failed to reserve seats\n");
+          break;
+        }
+
+        for (size_t i = 0; i < num_coords; i++) {
+          char seat[64];
+          snprintf(seat, sizeof(seat), "(%zu,%zu)%s", xs[i], ys[i], i + 1 < num_coords ? " " : "\n");
+          if (print_str(out_fd, seat)) fprintf(stderr, "Failed to write reserved seats\n");
+        }
+        break;
+
+      case CMD_TRANSACTION: {
+        unsigned int event_ids[MAX_TRANSACTION_EVENTS];
+        size_t num_seats[MAX_TRANSACTION_EVENTS];
+        size_t num_groups =
+            parse_transaction(in_fd, MAX_TRANSACTION_EVENTS, MAX_RESERVATION_SIZE, event_ids, num_seats, xs, ys);
+
+        if (num_groups == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_reserve_transaction(num_groups, event_ids, num_seats, xs, ys))
+          fprintf(stderr, "Failed to reserve seats\n");
+        break;
+      }
+
+      case CMD_CANCEL: {
+        unsigned int reservation_id;
+        if (parse_cancel(in_fd, &event_id, &reservation_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_cancel(event_id, reservation_id)) fprintf(stderr, "Failed to cancel reservation\n");
+        break;
+      }
+
+      case CMD_HOLD: {
+        unsigned int ttl_ms, hold_id;
+        num_coords = parse_hold(in_fd, MAX_RESERVATION_SIZE, &event_id, &ttl_ms, xs, ys);
+
+        if (num_coords == 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_hold(event_id, ttl_ms, num_coords, xs, ys, &hold_id)) {
+          fprintf(stderr, "Failed to hold seats\n");
+          break;
+        }
+
+        char hold[32];
+        snprintf(hold, sizeof(hold), "Hold: %u\n", hold_id);
+        if (print_str(out_fd, hold)) fprintf(stderr, "Failed to write hold id\n");
+        break;
+      }
+
+      case CMD_CONFIRM: {
+        unsigned int hold_id;
+        if (parse_confirm(in_fd, &event_id, &hold_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_confirm(event_id, hold_id)) fprintf(stderr, "Failed to confirm hold\n");
+        break;
+      }
+
       case CMD_SHOW:
         if (parse_show(in_fd, &event_id) != 0) {
           fprintf(stderr, "Invalid command. See HELP for usage\n");
@@ -78,16 +169,40 @@ int main(int argc, char* argv[]) {
         if (ems_show(out_fd, event_id)) fprintf(stderr, "Failed to show event\n");
         break;
 
+      case CMD_AVAILABILITY:
+        if (parse_availability(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_availability(out_fd, event_id)) fprintf(stderr, "Failed to get event availability\n");
+        break;
+
       case CMD_LIST_EVENTS:
         if (ems_list_events(out_fd)) fprintf(stderr, "Failed to list events\n");
         break;
 
+      case CMD_REPORT:
+        if (ems_report(out_fd)) fprintf(stderr, "Failed to report events\n");
+        break;
+
+      case CMD_DELETE:
+        if (parse_delete(in_fd, &event_id) != 0) {
+          fprintf(stderr, "Invalid command. See HELP for usage\n");
+          continue;
+        }
+
+        if (ems_delete(event_id)) fprintf(stderr, "Failed to delete event\n");
+        break;
+
       case CMD_WAIT:
         if (parse_wait(in_fd, &delay, NULL) == -1) {
             fprintf(stderr, "Invalid command. See HELP for usage\n");
             continue;
         }
 
+        // Waiting only makes sense once the commands before it are done
+        ems_flush();
         if (delay > 0) {
             printf("Waiting...\n");
             sleep(delay);
@@ -103,8 +218,16 @@ int main(int argc, char* argv[]) {
             "Available commands:\n"
             "  CREATE <event_id> <num_rows> <num_columns>\n"
             "  RESERVE <event_id> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  BEST <event_id> <num_seats>\n"
+            "  TRANSACTION <event_id> [(<x1>,<y1>) ...] <event_id> [(<x1>,<y1>) ...] ...\n"
+            "  CANCEL <event_id> <reservation_id>\n"
+            "  HOLD <event_id> <ttl_ms> [(<x1>,<y1>) (<x2>,<y2>) ...]\n"
+            "  CONFIRM <event_id> <hold_id>\n"
             "  SHOW <event_id>\n"
+            "  AVAILABILITY <event_id>\n"
             "  LIST\n"
+            "  REPORT\n"
+            "  DELETE <event_id>\n"
             "  WAIT <delay_ms>\n"
             "  HELP\n");
 
@@ -114,6 +237,7 @@ int main(int argc, char* argv[]) {
         break;
 
       case EOC:
+        ems_flush();  // Responses still in flight are printed to out_fd
         close(in_fd);
         close(out_fd);
         ems_quit();
@@ -22,21 +22,56 @@ enum Command get_next(int fd) {
 
   switch (buf[0]) {
     case 'C':
-      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "CREATE ", 7) != 0) {
+      if (read(fd, buf + 1, 6) != 6) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
-      return CMD_CREATE;
+      if (strncmp(buf, "CREATE ", 7) == 0) {
+        return CMD_CREATE;
+      }
+
+      if (strncmp(buf, "CANCEL ", 7) == 0) {
+        return CMD_CANCEL;
+      }
+
+      if (strncmp(buf, "CONFIRM", 7) == 0 && read(fd, buf + 7, 1) == 1 && strncmp(buf, "CONFIRM ", 8) == 0) {
+        return CMD_CONFIRM;
+      }
+
+      cleanup(fd);
+      return CMD_INVALID;
 
     case 'R':
-      if (read(fd, buf + 1, 7) != 7 || strncmp(buf, "RESERVE ", 8) != 0) {
+      if (read(fd, buf + 1, 5) != 5) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (strncmp(buf, "REPORT", 6) == 0) {
+        if (read(fd, buf + 6, 1) != 0 && buf[6] != '\n') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_REPORT;
+      }
+
+      if (read(fd, buf + 6, 2) != 2 || strncmp(buf, "RESERVE ", 8) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
 
       return CMD_RESERVE;
 
+    case 'B':
+      if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "BEST ", 5) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_BEST;
+
     case 'S':
       if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "SHOW ", 5) != 0) {
         cleanup(fd);
@@ -45,6 +80,14 @@ enum Command get_next(int fd) {
 
       return CMD_SHOW;
 
+    case 'A':
+      if (read(fd, buf + 1, 12) != 12 || strncmp(buf, "AVAILABILITY ", 13) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_AVAILABILITY;
+
     case 'L':
       if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "LIST", 4) != 0) {
         cleanup(fd);
@@ -58,6 +101,22 @@ enum Command get_next(int fd) {
 
       return CMD_LIST_EVENTS;
 
+    case 'D':
+      if (read(fd, buf + 1, 6) != 6 || strncmp(buf, "DELETE ", 7) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_DELETE;
+
+    case 'T':
+      if (read(fd, buf + 1, 11) != 11 || strncmp(buf, "TRANSACTION ", 12) != 0) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      return CMD_TRANSACTION;
+
     case 'W':
       if (read(fd, buf + 1, 4) != 4 || strncmp(buf, "WAIT ", 5) != 0) {
         cleanup(fd);
@@ -67,7 +126,21 @@ enum Command get_next(int fd) {
       return CMD_WAIT;
 
     case 'H':
-      if (read(fd, buf + 1, 3) != 3 || strncmp(buf, "HELP", 4) != 0) {
+      if (read(fd, buf + 1, 3) != 3) {
+        cleanup(fd);
+        return CMD_INVALID;
+      }
+
+      if (strncmp(buf, "HOLD", 4) == 0) {
+        if (read(fd, buf + 4, 1) != 1 || buf[4] != ' ') {
+          cleanup(fd);
+          return CMD_INVALID;
+        }
+
+        return CMD_HOLD;
+      }
+
+      if (strncmp(buf, "HELP", 4) != 0) {
         cleanup(fd);
         return CMD_INVALID;
       }
@@ -117,14 +190,15 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
   return 0;
 }
 
-size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+/// Parses a list of seats, "[(<x1>,<y1>) (<x2>,<y2>) ...]", up to the end of the line.
+/// @param fd File descriptor to read from.
+/// @param max Maximum number of coordinates to read.
+/// @param xs Pointer to the array to store the X coordinates in.
+/// @param ys Pointer to the array to store the Y coordinates in.
+/// @return Number of coordinates read. 0 on failure.
+static size_t parse_coords(int fd, size_t max, size_t *xs, size_t *ys) {
   char ch;
 
-  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
-    cleanup(fd);
-    return 0;
-  }
-
   if (read(fd, &ch, 1) != 1 || ch != '[') {
     cleanup(fd);
     return 0;
@@ -176,6 +250,140 @@ size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, siz
   return num_coords;
 }
 
+size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 0;
+  }
+
+  return parse_coords(fd, max, xs, ys);
+}
+
+size_t parse_hold(int fd, size_t max, unsigned int *event_id, unsigned int *ttl_ms, size_t *xs, size_t *ys) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 0;
+  }
+
+  if (parse_uint(fd, ttl_ms, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 0;
+  }
+
+  return parse_coords(fd, max, xs, ys);
+}
+
+size_t parse_transaction(int fd, size_t max_groups, size_t max_coords, unsigned int *event_ids, size_t *num_coords,
+                         size_t *xs, size_t *ys) {
+  char ch = ' ';
+  size_t num_groups = 0, total = 0;
+
+  while (ch == ' ') {
+    if (num_groups == max_groups || parse_uint(fd, &event_ids[num_groups], &ch) != 0 || ch != ' ') {
+      cleanup(fd);
+      return 0;
+    }
+
+    if (read(fd, &ch, 1) != 1 || ch != '[') {
+      cleanup(fd);
+      return 0;
+    }
+
+    num_coords[num_groups] = 0;
+    do {
+      if (total == max_coords || read(fd, &ch, 1) != 1 || ch != '(') {
+        cleanup(fd);
+        return 0;
+      }
+
+      unsigned int x;
+      if (parse_uint(fd, &x, &ch) != 0 || ch != ',') {
+        cleanup(fd);
+        return 0;
+      }
+      xs[total] = (size_t)x;
+
+      unsigned int y;
+      if (parse_uint(fd, &y, &ch) != 0 || ch != ')') {
+        cleanup(fd);
+        return 0;
+      }
+      ys[total] = (size_t)y;
+
+      total++;
+      num_coords[num_groups]++;
+
+      if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != ']')) {
+        cleanup(fd);
+        return 0;
+      }
+    } while (ch != ']');
+
+    num_groups++;
+
+    if (read(fd, &ch, 1) != 1 || (ch != ' ' && ch != '\n' && ch != '\0')) {
+      cleanup(fd);
+      return 0;
+    }
+  }
+
+  return num_groups;
+}
+
+int parse_best(int fd, unsigned int *event_id, size_t *num_seats) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 1;
+  }
+
+  unsigned int u_num_seats;
+  if (parse_uint(fd, &u_num_seats, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+  *num_seats = (size_t)u_num_seats;
+
+  return 0;
+}
+
+int parse_cancel(int fd, unsigned int *event_id, unsigned int *reservation_id) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 1;
+  }
+
+  if (parse_uint(fd, reservation_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_confirm(int fd, unsigned int *event_id, unsigned int *hold_id) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || ch != ' ') {
+    cleanup(fd);
+    return 1;
+  }
+
+  if (parse_uint(fd, hold_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
 int parse_show(int fd, unsigned int *event_id) {
   char ch;
 
@@ -187,6 +395,28 @@ int parse_show(int fd, unsigned int *event_id) {
   return 0;
 }
 
+int parse_availability(int fd, unsigned int *event_id) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
+int parse_delete(int fd, unsigned int *event_id) {
+  char ch;
+
+  if (parse_uint(fd, event_id, &ch) != 0 || (ch != '\n' && ch != '\0')) {
+    cleanup(fd);
+    return 1;
+  }
+
+  return 0;
+}
+
 int parse_wait(int fd, unsigned int *delay, unsigned int *thread_id) {
   char ch;
 
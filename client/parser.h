@@ -6,8 +6,16 @@
 enum Command {
   CMD_CREATE,
   CMD_RESERVE,
+  CMD_BEST,
+  CMD_TRANSACTION,
+  CMD_CANCEL,
+  CMD_HOLD,
+  CMD_CONFIRM,
   CMD_SHOW,
+  CMD_AVAILABILITY,
   CMD_LIST_EVENTS,
+  CMD_REPORT,
+  CMD_DELETE,
   CMD_WAIT,
   CMD_HELP,
   CMD_EMPTY,
@@ -37,12 +45,67 @@ int parse_create(int fd, unsigned int *event_id, size_t *num_rows, size_t *num_c
 /// @return Number of coordinates read. 0 on failure.
 size_t parse_reserve(int fd, size_t max, unsigned int *event_id, size_t *xs, size_t *ys);
 
+/// Parses a BEST command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param num_seats Pointer to the variable to store the number of seats in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_best(int fd, unsigned int *event_id, size_t *num_seats);
+
+/// Parses a TRANSACTION command: one or more events, each followed by its seats as in RESERVE.
+/// @param fd File descriptor to read from.
+/// @param max_groups Maximum number of events to read.
+/// @param max_coords Maximum number of coordinates to read, over all events.
+/// @param event_ids Pointer to the array to store the event IDs in.
+/// @param num_coords Pointer to the array to store the number of coordinates of each event in.
+/// @param xs Pointer to the array to store the X coordinates in, each event's following the previous one's.
+/// @param ys Pointer to the array to store the Y coordinates in.
+/// @return Number of events read. 0 on failure.
+size_t parse_transaction(int fd, size_t max_groups, size_t max_coords, unsigned int *event_ids, size_t *num_coords,
+                         size_t *xs, size_t *ys);
+
+/// Parses a CANCEL command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param reservation_id Pointer to the variable to store the reservation ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_cancel(int fd, unsigned int *event_id, unsigned int *reservation_id);
+
+/// Parses a HOLD command: an event, the time to hold its seats for, and the seats as in RESERVE.
+/// @param fd File descriptor to read from.
+/// @param max Maximum number of coordinates to read.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param ttl_ms Pointer to the variable to store the hold time (in milliseconds) in.
+/// @param xs Pointer to the array to store the X coordinates in.
+/// @param ys Pointer to the array to store the Y coordinates in.
+/// @return Number of coordinates read. 0 on failure.
+size_t parse_hold(int fd, size_t max, unsigned int *event_id, unsigned int *ttl_ms, size_t *xs, size_t *ys);
+
+/// Parses a CONFIRM command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @param hold_id Pointer to the variable to store the hold ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_confirm(int fd, unsigned int *event_id, unsigned int *hold_id);
+
 /// Parses a SHOW command.
 /// @param fd File descriptor to read from.
 /// @param event_id Pointer to the variable to store the event ID in.
 /// @return 0 if the command was parsed successfully, 1 otherwise.
 int parse_show(int fd, unsigned int *event_id);
 
+/// Parses an AVAILABILITY command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_availability(int fd, unsigned int *event_id);
+
+/// Parses a DELETE command.
+/// @param fd File descriptor to read from.
+/// @param event_id Pointer to the variable to store the event ID in.
+/// @return 0 if the command was parsed successfully, 1 otherwise.
+int parse_delete(int fd, unsigned int *event_id);
+
 /// Parses a WAIT command.
 /// @param fd File descriptor to read from.
 /// @param delay Pointer to the variable to store the wait delay in.
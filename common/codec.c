@@ -0,0 +1,232 @@
+#include "codec.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/// Reads exactly the given number of bytes.
+/// @param channel Channel to read from.
+/// @param buffer Buffer to read into.
+/// @param size Number of bytes to read.
+/// @return 0 if every byte was read, 1 otherwise.
+static int read_all(const struct Channel *channel, void *buffer, size_t size) {
+  if (channel->ring != NULL) return ring_read(channel->ring, buffer, size);
+
+  unsigned char *cursor = buffer;
+  while (size > 0) {
+    ssize_t bytes_read = read(channel->fd, cursor, size);
+    if (bytes_read <= 0) return 1;
+    cursor += bytes_read;
+    size -= (size_t)bytes_read;
+  }
+  return 0;
+}
+
+/// Writes exactly the given number of bytes.
+/// @param channel Channel to write to.
+/// @param buffer Bytes to write.
+/// @param size Number of bytes to write.
+/// @return 0 if every byte was written, 1 otherwise.
+static int write_all(const struct Channel *channel, const void *buffer, size_t size) {
+  if (channel->ring != NULL) return ring_write(channel->ring, buffer, size);
+
+  const unsigned char *cursor = buffer;
+  while (size > 0) {
+    // Each write to a seqpacket socket is a record, sent whole or not at all
+    size_t chunk = channel->records && size > MAX_RECORD_SIZE ? MAX_RECORD_SIZE : size;
+    ssize_t written = write(channel->fd, cursor, chunk);
+    if (written == -1) return 1;
+    cursor += written;
+    size -= (size_t)written;
+  }
+  return 0;
+}
+
+/// Takes the fields of a frame header.
+/// @param bytes The FRAME_HEADER_SIZE bytes of the header.
+/// @param header Pointer to store the header in.
+static void parse_header(const unsigned char *bytes, struct FrameHeader *header) {
+  header->opcode = bytes[0];
+  memcpy(&header->tag, bytes + sizeof(uint8_t), sizeof(uint32_t));
+  memcpy(&header->size, bytes + sizeof(uint8_t) + sizeof(uint32_t), sizeof(uint32_t));
+}
+
+/// Reads the header of a frame.
+/// @param channel Channel to read from.
+/// @param header Pointer to store the header in.
+/// @return 0 if the header was read, 1 otherwise.
+static int read_header(const struct Channel *channel, struct FrameHeader *header) {
+  unsigned char bytes[FRAME_HEADER_SIZE];
+  if (channel->ring == NULL && channel->records) {
+    // Reading part of a record drops the rest, so the header is only peeked at and read along with the payload
+    if (recv(channel->fd, bytes, FRAME_HEADER_SIZE, MSG_PEEK) != (ssize_t)FRAME_HEADER_SIZE) return 1;
+  } else if (read_all(channel, bytes, FRAME_HEADER_SIZE) != 0) {
+    return 1;
+  }
+
+  parse_header(bytes, header);
+  return 0;
+}
+
+/// Reads the payload of a frame whose header was just read.
+/// @param channel Channel to read from.
+/// @param payload Buffer to read into.
+/// @param size Size of the payload.
+/// @return 0 if the payload was read, 1 otherwise.
+static int read_payload(const struct Channel *channel, void *payload, size_t size) {
+  if (channel->ring != NULL || !channel->records) return read_all(channel, payload, size);
+
+  // The first record holds the header and the start of the payload; the records after it, the rest of the payload
+  unsigned char header[FRAME_HEADER_SIZE];
+  struct iovec parts[2] = {{.iov_base = header, .iov_len = sizeof(header)}, {.iov_base = payload, .iov_len = size}};
+  ssize_t bytes_read = readv(channel->fd, parts, 2);
+  if (bytes_read < (ssize_t)FRAME_HEADER_SIZE) return 1;
+
+  size_t taken = (size_t)bytes_read - FRAME_HEADER_SIZE;
+  return read_all(channel, (unsigned char *)payload + taken, size - taken);
+}
+
+/// Fills in the tag and payload length of a frame.
+/// @param enc Encoder holding the frame.
+/// @param tag Tag of the frame.
+/// @return 0 if the frame is complete, 1 if a field did not fit or the payload is too long.
+static int seal_frame(struct Encoder *enc, uint32_t tag) {
+  if (enc->overflow || enc->size - FRAME_HEADER_SIZE > UINT32_MAX) return 1;
+
+  uint32_t length = (uint32_t)(enc->size - FRAME_HEADER_SIZE);
+  memcpy(enc->data + sizeof(uint8_t), &tag, sizeof(uint32_t));
+  memcpy(enc->data + sizeof(uint8_t) + sizeof(uint32_t), &length, sizeof(uint32_t));
+  return 0;
+}
+
+void encode_begin(struct Encoder *enc, void *buffer, size_t capacity, uint8_t opcode) {
+  enc->data = buffer;
+  enc->capacity = capacity;
+  enc->size = FRAME_HEADER_SIZE;
+  enc->overflow = capacity < FRAME_HEADER_SIZE;
+  if (!enc->overflow) enc->data[0] = opcode;
+}
+
+void *encode_reserve(struct Encoder *enc, size_t size) {
+  if (enc->overflow || size > enc->capacity - enc->size) {
+    enc->overflow = 1;
+    return NULL;
+  }
+
+  void *field = enc->data + enc->size;
+  enc->size += size;
+  return field;
+}
+
+void encode_u32(struct Encoder *enc, uint32_t value) {
+  void *field = encode_reserve(enc, sizeof(value));
+  if (field != NULL) memcpy(field, &value, sizeof(value));
+}
+
+void encode_u64(struct Encoder *enc, uint64_t value) {
+  void *field = encode_reserve(enc, sizeof(value));
+  if (field != NULL) memcpy(field, &value, sizeof(value));
+}
+
+void encode_i32(struct Encoder *enc, int32_t value) {
+  void *field = encode_reserve(enc, sizeof(value));
+  if (field != NULL) memcpy(field, &value, sizeof(value));
+}
+
+void encode_frame(struct Encoder *enc, struct Encoder *frame, uint32_t tag) {
+  if (seal_frame(frame, tag) != 0) {
+    enc->overflow = 1;
+    return;
+  }
+
+  void *field = encode_reserve(enc, frame->size);
+  if (field != NULL) memcpy(field, frame->data, frame->size);
+}
+
+uint8_t encoded_opcode(const struct Encoder *enc) { return enc->data[0]; }
+
+int send_frame(const struct Channel *channel, struct Encoder *enc, uint32_t tag) {
+  if (seal_frame(enc, tag) != 0) return 1;
+  return write_all(channel, enc->data, enc->size);
+}
+
+int send_status(const struct Channel *channel, uint8_t opcode, uint32_t tag, int32_t status) {
+  unsigned char buffer[FRAME_HEADER_SIZE + sizeof(int32_t)];
+  struct Encoder enc;
+  encode_begin(&enc, buffer, sizeof(buffer), opcode);
+  encode_i32(&enc, status);
+  return send_frame(channel, &enc, tag);
+}
+
+int read_frame(const struct Channel *channel, struct FrameHeader *header, void *payload, size_t capacity) {
+  if (read_header(channel, header) != 0 || header->size > capacity) return 1;
+  return read_payload(channel, payload, header->size);
+}
+
+int read_frame_alloc(const struct Channel *channel, struct FrameHeader *header, void **payload, size_t capacity) {
+  if (read_header(channel, header) != 0 || header->size > capacity) return 1;
+
+  // At least one byte, so an empty payload is still a pointer the caller can free
+  *payload = malloc(header->size > 0 ? header->size : 1);
+  if (*payload == NULL) return 1;
+  if (read_payload(channel, *payload, header->size) != 0) {
+    free(*payload);
+    *payload = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+int channel_has_data(const struct Channel *channel) {
+  if (channel->ring != NULL) return ring_has_data(channel->ring);
+
+  int available = 0;
+  return ioctl(channel->fd, FIONREAD, &available) == 0 && available > 0;
+}
+
+void decode_begin(struct Decoder *dec, const void *payload, size_t size) {
+  dec->data = payload;
+  dec->size = size;
+  dec->offset = 0;
+}
+
+const void *decode_bytes(struct Decoder *dec, size_t size) {
+  if (size > dec->size - dec->offset) return NULL;
+
+  const void *field = dec->data + dec->offset;
+  dec->offset += size;
+  return field;
+}
+
+int decode_frame(struct Decoder *dec, struct FrameHeader *header, const void **payload) {
+  const unsigned char *bytes = decode_bytes(dec, FRAME_HEADER_SIZE);
+  if (bytes == NULL) return 1;
+
+  parse_header(bytes, header);
+  *payload = decode_bytes(dec, header->size);
+  return *payload == NULL;
+}
+
+int decode_u32(struct Decoder *dec, uint32_t *value) {
+  const void *field = decode_bytes(dec, sizeof(*value));
+  if (field == NULL) return 1;
+  memcpy(value, field, sizeof(*value));
+  return 0;
+}
+
+int decode_u64(struct Decoder *dec, uint64_t *value) {
+  const void *field = decode_bytes(dec, sizeof(*value));
+  if (field == NULL) return 1;
+  memcpy(value, field, sizeof(*value));
+  return 0;
+}
+
+int decode_i32(struct Decoder *dec, int32_t *value) {
+  const void *field = decode_bytes(dec, sizeof(*value));
+  if (field == NULL) return 1;
+  memcpy(value, field, sizeof(*value));
+  return 0;
+}
@@ -0,0 +1,171 @@
+#ifndef COMMON_CODEC_H
+#define COMMON_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "constants.h"
+#include "ring.h"
+
+// Every message is a frame: a one-byte opcode, a uint32_t tag, the length of the payload as a uint32_t, then the
+// payload. Payload fields have fixed widths (uint32_t for ids, uint64_t for sizes and coordinates) in host byte
+// order, since both ends share the host. A response carries the opcode and tag of its request, so responses can
+// come back in any order, and starts with an int32_t status (0 on success); whatever follows is only there on
+// success.
+#define FRAME_HEADER_SIZE (sizeof(uint8_t) + 2 * sizeof(uint32_t))
+
+// Largest request payload: a transaction of MAX_TRANSACTION_EVENTS events and MAX_RESERVATION_SIZE seats
+#define MAX_REQUEST_PAYLOAD                                                          \
+  (sizeof(uint64_t) + MAX_TRANSACTION_EVENTS * (sizeof(uint32_t) + sizeof(uint64_t)) + \
+   MAX_RESERVATION_SIZE * 2 * sizeof(uint64_t))
+
+// Largest payload of any frame read by the server, batches included; a batch may hold any single request
+#define MAX_BATCH_PAYLOAD (64 * 1024)
+
+// Operations, with the payload of the request -> the payload of the response after the status
+enum Opcode {
+  OP_QUIT = 2,           // (none) -> no response
+  OP_CREATE = 3,         // event_id, rows, cols
+  OP_RESERVE = 4,        // event_id, num_seats, num_seats * (row, col)
+  OP_SHOW = 5,           // event_id -> rows, cols, rows * cols * uint32_t seats
+  OP_LIST = 6,           // (none) -> num_events, num_events * event_id
+  OP_DELETE = 7,         // event_id
+  OP_BEST = 8,           // event_id, num_seats -> num_seats, num_seats * (row, col)
+  OP_TRANSACTION = 9,    // num_events, num_events * (event_id, num_seats, num_seats * (row, col))
+  OP_CANCEL = 10,        // event_id, reservation_id
+  OP_HOLD = 11,          // event_id, ttl_ms, num_seats, num_seats * (row, col) -> hold_id
+  OP_CONFIRM = 12,       // event_id, hold_id
+  OP_REPORT = 13,        // (none) -> num_events, num_events * (event_id, rows, cols, rows * cols * uint32_t seats)
+  OP_AVAILABILITY = 14,  // event_id -> free seats, rows, rows * free seats of the row
+  OP_BATCH = 15,         // num_ops, num_ops * request frame -> num_ops, num_ops * response frame (run in order)
+};
+
+// Largest record written to a channel that keeps message boundaries; longer frames span several records
+#define MAX_RECORD_SIZE (32 * 1024)
+
+// End of a connection frames are read from or written to: a file descriptor, or a ring in shared memory
+struct Channel {
+  int fd;
+  struct Ring *ring;  // Used instead of fd when not NULL
+  int records;        // Whether fd keeps message boundaries (a seqpacket socket), so a frame starts a record
+};
+
+// Header of a frame
+struct FrameHeader {
+  uint8_t opcode;
+  uint32_t tag;   // Chosen by the client for each request, echoed by its response
+  uint32_t size;  // Size of the payload
+};
+
+// Frame being encoded into a buffer owned by the caller
+struct Encoder {
+  unsigned char *data;  // Frame, header included
+  size_t capacity;      // Size of data
+  size_t size;          // Bytes encoded so far
+  int overflow;         // Whether a field did not fit (the frame is then not sent)
+};
+
+// Payload being decoded
+struct Decoder {
+  const unsigned char *data;
+  size_t size;
+  size_t offset;  // Bytes decoded so far
+};
+
+/// Starts a frame.
+/// @param enc Encoder to start.
+/// @param buffer Buffer the frame is encoded into, which must outlive the encoder.
+/// @param capacity Size of the buffer (FRAME_HEADER_SIZE plus the largest payload expected).
+/// @param opcode Opcode of the frame.
+void encode_begin(struct Encoder *enc, void *buffer, size_t capacity, uint8_t opcode);
+
+/// Appends a field to the frame.
+/// @param enc Encoder to append to.
+/// @param value Value of the field.
+void encode_u32(struct Encoder *enc, uint32_t value);
+void encode_u64(struct Encoder *enc, uint64_t value);
+void encode_i32(struct Encoder *enc, int32_t value);
+
+/// Appends room for raw bytes to the frame, to be filled in by the caller.
+/// @param enc Encoder to append to.
+/// @param size Number of bytes.
+/// @return Pointer to the bytes, NULL if they do not fit.
+void *encode_reserve(struct Encoder *enc, size_t size);
+
+/// Appends a whole frame to another, as used by batches.
+/// @param enc Encoder to append to.
+/// @param frame Encoder holding the frame to append.
+/// @param tag Tag of the appended frame.
+void encode_frame(struct Encoder *enc, struct Encoder *frame, uint32_t tag);
+
+/// Gets the opcode of a frame being encoded.
+/// @param enc Encoder holding the frame.
+/// @return Opcode given to encode_begin.
+uint8_t encoded_opcode(const struct Encoder *enc);
+
+/// Writes the frame.
+/// @note Frames larger than PIPE_BUF may be interleaved with those of other writers of the same pipe, so
+/// concurrent writers must serialize their frames.
+/// @param channel Channel to write to.
+/// @param enc Encoder holding the frame.
+/// @param tag Tag of the frame.
+/// @return 0 if the frame was written in full, 1 otherwise (including when a field did not fit).
+int send_frame(const struct Channel *channel, struct Encoder *enc, uint32_t tag);
+
+/// Writes a response made of the status alone.
+/// @param channel Channel to write to.
+/// @param opcode Opcode of the request being answered.
+/// @param tag Tag of the request being answered.
+/// @param status Status of the response.
+/// @return 0 if the response was written in full, 1 otherwise.
+int send_status(const struct Channel *channel, uint8_t opcode, uint32_t tag, int32_t status);
+
+/// Reads a frame into a buffer owned by the caller.
+/// @param channel Channel to read from.
+/// @param header Pointer to store the header of the frame in.
+/// @param payload Buffer to store the payload in.
+/// @param capacity Size of the buffer.
+/// @return 0 if the frame was read, 1 otherwise (end of file, error, or a payload larger than the buffer).
+int read_frame(const struct Channel *channel, struct FrameHeader *header, void *payload, size_t capacity);
+
+/// Reads a frame whose payload is allocated to its size.
+/// @param channel Channel to read from.
+/// @param header Pointer to store the header of the frame in.
+/// @param payload Pointer to store the newly allocated payload in. Must be freed by the caller.
+/// @param capacity Largest payload accepted.
+/// @return 0 if the frame was read, 1 otherwise (including when the payload is larger than capacity).
+int read_frame_alloc(const struct Channel *channel, struct FrameHeader *header, void **payload, size_t capacity);
+
+/// Checks whether a channel has bytes waiting to be read.
+/// @param channel Channel to check.
+/// @return Whether a read would get bytes without waiting (errors count as no bytes).
+int channel_has_data(const struct Channel *channel);
+
+/// Starts decoding a payload.
+/// @param dec Decoder to start.
+/// @param payload Payload to decode, which must outlive the decoder.
+/// @param size Size of the payload.
+void decode_begin(struct Decoder *dec, const void *payload, size_t size);
+
+/// Takes the next field of the payload.
+/// @param dec Decoder to take the field from.
+/// @param value Pointer to store the value of the field in.
+/// @return 0 if the field was decoded, 1 if the payload ends before it.
+int decode_u32(struct Decoder *dec, uint32_t *value);
+int decode_u64(struct Decoder *dec, uint64_t *value);
+int decode_i32(struct Decoder *dec, int32_t *value);
+
+/// Takes a whole frame from the payload, as used by batches.
+/// @param dec Decoder to take the frame from.
+/// @param header Pointer to store the header of the frame in.
+/// @param payload Pointer to store the payload of the frame in (possibly unaligned), which lives as long as dec's.
+/// @return 0 if the frame was decoded, 1 if the payload ends before it.
+int decode_frame(struct Decoder *dec, struct FrameHeader *header, const void **payload);
+
+/// Takes raw bytes from the payload.
+/// @param dec Decoder to take the bytes from.
+/// @param size Number of bytes.
+/// @return Pointer to the bytes (possibly unaligned), NULL if the payload ends before them.
+const void *decode_bytes(struct Decoder *dec, size_t size);
+
+#endif  // COMMON_CODEC_H
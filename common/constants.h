@@ -1,5 +1,13 @@
 #define MAX_RESERVATION_SIZE 256
+#define MAX_TRANSACTION_EVENTS 16
 #define STATE_ACCESS_DELAY_US 500000  // 500ms
+#define EVENT_SHARD_COUNT 16
+#define EVENT_CACHE_CAPACITY 1024  // Hot events served without the state access delay
+#define MAX_SEAT_STRIPES 64  // Must fit in a uint64_t mask
+#define SEAT_MAP_HUGE_PAGES 0  // Set to 1 to back large seat maps with transparent huge pages
 #define MAX_JOB_FILE_NAME_SIZE 256
 #define MAX_SESSION_COUNT 8
+#define REQUEST_EXECUTOR_COUNT 16  // Requests executed at once, across every session
+#define MAX_REQUESTS_IN_FLIGHT 64  // Requests a client may send before reading their responses
+#define MAX_BATCH_OPERATIONS 128  // Operations carried by a single BATCH request
 #define pipeBuffer 100
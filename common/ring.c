@@ -0,0 +1,235 @@
+#define _DEFAULT_SOURCE  // syscall
+
+#include "ring.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RING_SPIN_LIMIT 1000         // Checks of the ring before sleeping, enough to cover a quick answer
+#define RING_SLEEP_NS (50 * 1000000)  // Longest sleep before checking the other side is still alive
+
+/// Gets how many times to check a ring before sleeping.
+/// @return RING_SPIN_LIMIT, or 0 on a single CPU, where the other side cannot make progress while this one spins.
+static int spin_limit(void) {
+  static _Atomic int limit = -1;
+  int value = atomic_load_explicit(&limit, memory_order_relaxed);
+  if (value < 0) {
+    value = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? RING_SPIN_LIMIT : 0;
+    atomic_store_explicit(&limit, value, memory_order_relaxed);
+  }
+  return value;
+}
+
+/// Checks whether a process is still running.
+/// @param pid Process id, 0 if not known yet.
+/// @return Whether the process is alive (or not known).
+static int process_alive(pid_t pid) { return pid == 0 || kill(pid, 0) == 0 || errno != ESRCH; }
+
+/// Waits until a futex word changes from the given value, the ring is closed, or the other side died.
+/// @param ring Ring being waited on.
+/// @param word Futex word.
+/// @param value Value the word had when the wait was decided.
+/// @param sleeping Flag telling the other side to wake the word up.
+/// @param other Process on the other side of the ring.
+/// @return 0 if the word may have changed, 1 if the ring is closed or the other side died.
+static int wait_change(struct Ring *ring, _Atomic uint32_t *word, uint32_t value, _Atomic uint32_t *sleeping,
+                       _Atomic pid_t *other) {
+  for (int i = spin_limit(); i > 0; i--) {
+    if (atomic_load_explicit(word, memory_order_acquire) != value) return 0;
+  }
+
+  while (1) {
+    // The other side sets the word, then checks the flag; this side sets the flag, then checks the word
+    atomic_store(sleeping, 1);
+    if (atomic_load(word) != value) break;
+    if (atomic_load(&ring->closed)) {
+      atomic_store(sleeping, 0);
+      return 1;
+    }
+
+    struct timespec timeout = {.tv_sec = 0, .tv_nsec = RING_SLEEP_NS};
+    syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, value, &timeout, NULL, 0);
+    if (atomic_load(word) != value) break;
+    if (!process_alive(atomic_load(other))) {
+      atomic_store(sleeping, 0);
+      return 1;
+    }
+  }
+  atomic_store(sleeping, 0);
+  return 0;
+}
+
+/// Wakes up the other side of a ring if it sleeps on a futex word that was just changed.
+/// @param word Futex word.
+/// @param sleeping Flag set by the other side before sleeping.
+static void wake_change(_Atomic uint32_t *word, _Atomic uint32_t *sleeping) {
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(sleeping)) syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+int ring_write(struct Ring *ring, const void *buffer, size_t size) {
+  const unsigned char *cursor = buffer;
+  uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  while (size > 0) {
+    if (atomic_load_explicit(&ring->closed, memory_order_relaxed)) return 1;
+
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    size_t room = RING_CAPACITY - (size_t)(head - tail);
+    if (room == 0) {
+      if (wait_change(ring, &ring->tail, tail, &ring->writer_sleeping, &ring->reader) != 0) return 1;
+      continue;
+    }
+
+    size_t offset = head % RING_CAPACITY;
+    size_t chunk = size < room ? size : room;
+    if (chunk > RING_CAPACITY - offset) chunk = RING_CAPACITY - offset;
+    memcpy(ring->data + offset, cursor, chunk);
+    head += (uint32_t)chunk;
+    atomic_store_explicit(&ring->head, head, memory_order_release);
+    wake_change(&ring->head, &ring->reader_sleeping);
+
+    cursor += chunk;
+    size -= chunk;
+  }
+  return 0;
+}
+
+int ring_read(struct Ring *ring, void *buffer, size_t size) {
+  unsigned char *cursor = buffer;
+  uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  while (size > 0) {
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t available = (size_t)(head - tail);
+    if (available == 0) {
+      // Bytes written before the ring was closed are still read
+      if (atomic_load_explicit(&ring->closed, memory_order_acquire)) return 1;
+      if (wait_change(ring, &ring->head, head, &ring->reader_sleeping, &ring->writer) != 0 &&
+          atomic_load(&ring->head) == head) {
+        return 1;
+      }
+      continue;
+    }
+
+    size_t offset = tail % RING_CAPACITY;
+    size_t chunk = size < available ? size : available;
+    if (chunk > RING_CAPACITY - offset) chunk = RING_CAPACITY - offset;
+    memcpy(cursor, ring->data + offset, chunk);
+    tail += (uint32_t)chunk;
+    atomic_store_explicit(&ring->tail, tail, memory_order_release);
+    wake_change(&ring->tail, &ring->writer_sleeping);
+
+    cursor += chunk;
+    size -= chunk;
+  }
+  return 0;
+}
+
+int ring_has_data(struct Ring *ring) {
+  return atomic_load_explicit(&ring->head, memory_order_acquire) !=
+         atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+void ring_close(struct Ring *ring) {
+  atomic_store(&ring->closed, 1);
+  syscall(SYS_futex, (uint32_t *)&ring->head, FUTEX_WAKE, 1, NULL, NULL, 0);
+  syscall(SYS_futex, (uint32_t *)&ring->tail, FUTEX_WAKE, 1, NULL, NULL, 0);
+}
+
+/// Maps a region.
+/// @param fd File descriptor of the shared memory object.
+/// @return Pointer to the region, NULL if it could not be mapped.
+static struct ShmRegion *map_region(int fd) {
+  void *address = mmap(NULL, sizeof(struct ShmRegion), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (address == MAP_FAILED) {
+    perror("Error mapping shared memory");
+    return NULL;
+  }
+  return address;
+}
+
+struct ShmRegion *shm_region_create(const char *name) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd == -1) {
+    perror("Error creating shared memory");
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(struct ShmRegion)) == -1) {
+    perror("Error sizing shared memory");
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // A new object reads as zeros, so the rings start empty and open
+  struct ShmRegion *region = map_region(fd);
+  if (region == NULL) {
+    shm_unlink(name);
+    return NULL;
+  }
+  region->magic = SHM_REGION_MAGIC;
+  atomic_store(&region->requests.writer, getpid());
+  atomic_store(&region->responses.reader, getpid());
+  return region;
+}
+
+/// Checks whether a name sent by a client is one of a session region, so the server maps nothing else.
+/// @param name Name to check.
+/// @return Whether the name is SHM_NAME_PREFIX followed by letters, digits and dashes, within SHM_NAME_SIZE bytes.
+static bool region_name_valid(const char *name) {
+  size_t prefix_size = strlen(SHM_NAME_PREFIX);
+  size_t size = strnlen(name, SHM_NAME_SIZE);
+  if (size == SHM_NAME_SIZE || size <= prefix_size || strncmp(name, SHM_NAME_PREFIX, prefix_size) != 0) return false;
+  for (size_t i = prefix_size; i < size; i++) {
+    if (!isalnum((unsigned char)name[i]) && name[i] != '-') return false;
+  }
+  return true;
+}
+
+struct ShmRegion *shm_region_open(const char *name) {
+  if (!region_name_valid(name)) {
+    fprintf(stderr, "Invalid shared memory name\n");
+    return NULL;
+  }
+
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd == -1) {
+    perror("Error opening shared memory");
+    return NULL;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) == -1 || (size_t)info.st_size < sizeof(struct ShmRegion)) {
+    fprintf(stderr, "Shared memory too small for a session\n");
+    close(fd);
+    return NULL;
+  }
+
+  struct ShmRegion *region = map_region(fd);
+  if (region == NULL) return NULL;
+  if (region->magic != SHM_REGION_MAGIC) {
+    fprintf(stderr, "Shared memory is not a session region\n");
+    munmap(region, sizeof(struct ShmRegion));
+    return NULL;
+  }
+  atomic_store(&region->requests.reader, getpid());
+  atomic_store(&region->responses.writer, getpid());
+  return region;
+}
+
+void shm_region_close(struct ShmRegion *region) {
+  ring_close(&region->requests);
+  ring_close(&region->responses);
+  munmap(region, sizeof(struct ShmRegion));
+}
@@ -0,0 +1,72 @@
+#ifndef COMMON_RING_H
+#define COMMON_RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#define RING_CAPACITY (256 * 1024)    // Bytes a ring holds, a power of two
+#define SHM_REGION_MAGIC 0x454d5331u  // "EMS1", checked by the server before using a region
+#define SHM_NAME_PREFIX "/ems-"       // Start of the name of every region, the only names the server maps
+#define SHM_NAME_SIZE 32              // Bytes of a region name, its terminator included
+
+// Bytes flowing one way between two processes sharing memory, with a single writer and a single reader.
+// Each side spins briefly, then sleeps on a futex, when the ring is full or empty.
+struct Ring {
+  _Alignas(64) _Atomic uint32_t head;  // Bytes ever written (wrapping), the futex the reader sleeps on
+  _Atomic uint32_t reader_sleeping;
+  _Alignas(64) _Atomic uint32_t tail;  // Bytes ever read (wrapping), the futex the writer sleeps on
+  _Atomic uint32_t writer_sleeping;
+  _Alignas(64) _Atomic uint32_t closed;  // Set once either side is done with the ring
+  _Atomic pid_t writer;  // Processes on each side, checked while sleeping in case the other one died
+  _Atomic pid_t reader;
+  _Alignas(64) unsigned char data[RING_CAPACITY];
+};
+
+// Memory shared by a client and the server for a session: requests flow one way, responses the other
+struct ShmRegion {
+  uint32_t magic;
+  struct Ring requests;
+  struct Ring responses;
+};
+
+/// Creates a region and maps it, for the client of a session.
+/// @param name Name of the region (see shm_open), which the caller unlinks once the server has mapped it.
+/// @return Pointer to the region, NULL if it could not be created.
+struct ShmRegion *shm_region_create(const char *name);
+
+/// Maps a region created by a client, for the server.
+/// @param name Name of the region, as sent by the client: names not made of SHM_NAME_PREFIX followed by letters,
+/// digits and dashes, or not fitting in SHM_NAME_SIZE bytes, are refused.
+/// @return Pointer to the region, NULL if the name is refused, or if it could not be mapped or is not a region.
+struct ShmRegion *shm_region_open(const char *name);
+
+/// Closes both rings of a region and unmaps it.
+/// @param region Region to unmap.
+void shm_region_close(struct ShmRegion *region);
+
+/// Writes bytes to a ring, waiting for room as needed.
+/// @param ring Ring to write to.
+/// @param buffer Bytes to write.
+/// @param size Number of bytes to write.
+/// @return 0 if every byte was written, 1 if the ring was closed (or its reader died) first.
+int ring_write(struct Ring *ring, const void *buffer, size_t size);
+
+/// Reads bytes from a ring, waiting for them as needed.
+/// @param ring Ring to read from.
+/// @param buffer Buffer to read into.
+/// @param size Number of bytes to read.
+/// @return 0 if every byte was read, 1 if the ring was closed (or its writer died) first.
+int ring_read(struct Ring *ring, void *buffer, size_t size);
+
+/// Checks whether a ring holds bytes not yet read.
+/// @param ring Ring to check.
+/// @return Whether the reader would get bytes without waiting.
+int ring_has_data(struct Ring *ring);
+
+/// Closes a ring, waking up both sides.
+/// @param ring Ring to close.
+void ring_close(struct Ring *ring);
+
+#endif  // COMMON_RING_H
@@ -0,0 +1,534 @@
+#define _DEFAULT_SOURCE  // MAP_ANONYMOUS and madvise
+#include "allocator.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define ALLOC_ALIGNMENT 16
+#define ARENA_CHUNK_SIZE (1 << 20)                   // 1 MiB
+#define ARENA_LARGE_BLOCK (ARENA_CHUNK_SIZE / 4)  // Blocks at least this big get a mapping of their own
+#define ARENA_MIN_CLASS 32                        // Smallest block, header included
+#define HUGE_PAGE_SIZE (2 << 20)                   // 2 MiB, the size of a transparent huge page on x86-64 and arm64
+#define THREAD_SLAB_CHUNK_SIZE (64 << 10)         // 64 KiB
+#define THREAD_SLAB_MIN_CLASS 32                  // Smallest thread slab block, header included
+
+_Static_assert((ARENA_MIN_CLASS << (ARENA_SIZE_CLASSES - 1)) < ARENA_LARGE_BLOCK,
+               "every size class must fit in a shared chunk");
+
+struct SlabChunk {
+  struct SlabChunk* next;
+  _Alignas(ALLOC_ALIGNMENT) unsigned char objects[];
+};
+
+struct ArenaChunk {
+  struct Arena* arena;  // Arena the chunk belongs to
+  size_t capacity;      // Bytes available for blocks
+  size_t used;          // Bytes already carved out
+  size_t live;          // Blocks carved out and not yet freed
+  int mapped;           // Whether the chunk is an anonymous mapping rather than a heap allocation
+  void* mapping;        // Start of the mapping of a mapped chunk, which may begin before the chunk
+  size_t mapping_size;  // Bytes of the mapping of a mapped chunk
+  _Alignas(ALLOC_ALIGNMENT) unsigned char blocks[];
+};
+
+// Placed right before every arena block, so it can be freed without knowing its arena
+struct ArenaHeader {
+  struct ArenaChunk* chunk;
+  size_t size;  // Bytes of the block, header included: its class size, or the whole mapping of a large block
+};
+
+// Overlays the bytes of a freed block of a shared chunk, linking it into the free list of its class. The list
+// is doubly linked, so the blocks of a chunk being released can be taken out of it wherever they sit.
+struct ArenaFreeBlock {
+  struct ArenaFreeBlock* prev;
+  struct ArenaFreeBlock* next;
+};
+
+_Static_assert(sizeof(struct ArenaHeader) + sizeof(struct ArenaFreeBlock) <= ARENA_MIN_CLASS,
+               "a free block must fit in the smallest class");
+
+// Overlays the bytes of a freed thread slab block, linking it into a free list or a remote stack
+struct ThreadFreeBlock {
+  struct ThreadFreeBlock* next;
+};
+
+// Blocks and chunks of one thread. Only its owner touches the free lists and chunks; other threads only push
+// onto the remote stack, and read the statistics.
+struct ThreadCache {
+  struct ThreadSlab* slab;                                    // Slab the cache belongs to
+  struct ThreadCache* next;                                   // Next cache of the slab
+  atomic_bool in_use;                                         // Whether a live thread owns the cache
+  struct ThreadFreeBlock* free_blocks[THREAD_SLAB_SIZE_CLASSES];  // Freed blocks of each class, ready for reuse
+  _Atomic(struct ThreadFreeBlock*) remote_blocks;             // Blocks freed by other threads, of any class
+  struct SlabChunk* chunks;                                   // Every chunk of the cache, newest first
+  size_t used;                                                // Bytes already carved out of the newest chunk
+  atomic_size_t num_chunks;                                   // Statistics, only written by the owner
+  atomic_size_t bytes_reserved;
+  atomic_size_t bytes_in_use;
+  atomic_size_t live;
+};
+
+// Placed right before every thread slab block, so it can be freed from any thread
+struct ThreadHeader {
+  struct ThreadCache* cache;  // Cache the block was carved by
+  size_t size_class;          // Class of the block
+};
+
+_Static_assert(sizeof(struct ThreadHeader) + sizeof(struct ThreadFreeBlock) <= THREAD_SLAB_MIN_CLASS,
+               "a free block must fit in the smallest thread slab class");
+_Static_assert((THREAD_SLAB_MIN_CLASS << (THREAD_SLAB_SIZE_CLASSES - 1)) <= THREAD_SLAB_CHUNK_SIZE,
+               "every thread slab class must fit in a chunk");
+
+static size_t align_up(size_t size) { return (size + ALLOC_ALIGNMENT - 1) & ~(size_t)(ALLOC_ALIGNMENT - 1); }
+
+int slab_init(struct Slab* slab, size_t object_size, size_t objects_per_chunk) {
+  if (pthread_mutex_init(&slab->mutex, NULL) != 0) return 1;
+
+  slab->object_size = align_up(object_size < sizeof(void*) ? sizeof(void*) : object_size);
+  slab->objects_per_chunk = objects_per_chunk > 0 ? objects_per_chunk : 1;
+  slab->free_objects = NULL;
+  slab->chunks = NULL;
+  memset(&slab->stats, 0, sizeof(slab->stats));
+  return 0;
+}
+
+/// Carves a new chunk into objects and pushes them onto the free list.
+/// @note Must be called with the slab's mutex held.
+/// @return 0 if the slab was grown successfully, 1 otherwise.
+static int slab_grow(struct Slab* slab) {
+  size_t size = sizeof(struct SlabChunk) + slab->object_size * slab->objects_per_chunk;
+  struct SlabChunk* chunk = malloc(size);
+  if (chunk == NULL) return 1;
+
+  chunk->next = slab->chunks;
+  slab->chunks = chunk;
+
+  // Push the objects in reverse, so they are handed out in address order
+  for (size_t i = slab->objects_per_chunk; i > 0; i--) {
+    void* object = chunk->objects + (i - 1) * slab->object_size;
+    *(void**)object = slab->free_objects;
+    slab->free_objects = object;
+  }
+
+  slab->stats.chunks++;
+  slab->stats.bytes_reserved += size;
+  return 0;
+}
+
+void* slab_alloc(struct Slab* slab) {
+  pthread_mutex_lock(&slab->mutex);
+
+  if (slab->free_objects == NULL && slab_grow(slab) != 0) {
+    pthread_mutex_unlock(&slab->mutex);
+    return NULL;
+  }
+
+  void* object = slab->free_objects;
+  slab->free_objects = *(void**)object;
+  slab->stats.live++;
+  slab->stats.bytes_in_use += slab->object_size;
+
+  pthread_mutex_unlock(&slab->mutex);
+  return object;
+}
+
+void slab_free(struct Slab* slab, void* object) {
+  if (object == NULL) return;
+
+  pthread_mutex_lock(&slab->mutex);
+  *(void**)object = slab->free_objects;
+  slab->free_objects = object;
+  slab->stats.live--;
+  slab->stats.bytes_in_use -= slab->object_size;
+  pthread_mutex_unlock(&slab->mutex);
+}
+
+void slab_destroy(struct Slab* slab) {
+  while (slab->chunks != NULL) {
+    struct SlabChunk* chunk = slab->chunks;
+    slab->chunks = chunk->next;
+    free(chunk);
+  }
+  pthread_mutex_destroy(&slab->mutex);
+}
+
+/// Gets the size class of a block.
+/// @param needed Bytes of the block, header included.
+/// @return Index of the smallest class the block fits in, ARENA_SIZE_CLASSES if it fits in none.
+static size_t size_class(size_t needed) {
+  size_t index = 0;
+  while (index < ARENA_SIZE_CLASSES && ((size_t)ARENA_MIN_CLASS << index) < needed) index++;
+  return index;
+}
+
+/// Gets the free block overlaying the bytes of a block.
+static struct ArenaFreeBlock* free_block_of(struct ArenaHeader* header) {
+  return (struct ArenaFreeBlock*)((unsigned char*)header + sizeof(struct ArenaHeader));
+}
+
+/// Pushes a freed block onto the free list of its class.
+/// @note Must be called with the arena's mutex held.
+static void push_free_block(struct Arena* arena, struct ArenaHeader* header) {
+  struct ArenaFreeBlock** list = &arena->free_blocks[size_class(header->size)];
+  struct ArenaFreeBlock* block = free_block_of(header);
+  block->prev = NULL;
+  block->next = *list;
+  if (*list != NULL) (*list)->prev = block;
+  *list = block;
+}
+
+/// Takes a block out of the free list of its class.
+/// @note Must be called with the arena's mutex held.
+static void unlink_free_block(struct Arena* arena, struct ArenaHeader* header) {
+  struct ArenaFreeBlock* block = free_block_of(header);
+  if (block->prev != NULL) {
+    block->prev->next = block->next;
+  } else {
+    arena->free_blocks[size_class(header->size)] = block->next;
+  }
+  if (block->next != NULL) block->next->prev = block->prev;
+}
+
+int arena_init(struct Arena* arena, int huge_pages) {
+  if (pthread_mutex_init(&arena->mutex, NULL) != 0) return 1;
+
+  arena->current = NULL;
+  memset(arena->free_blocks, 0, sizeof(arena->free_blocks));
+  arena->huge_pages = huge_pages;
+  memset(&arena->stats, 0, sizeof(arena->stats));
+  return 0;
+}
+
+/// Obtains a zeroed chunk from the system.
+/// @note Must be called with the arena's mutex held.
+/// @return Newly allocated chunk, NULL on failure.
+static struct ArenaChunk* arena_chunk_create(struct Arena* arena, size_t capacity) {
+  struct ArenaChunk* chunk = calloc(1, sizeof(struct ArenaChunk) + capacity);
+  if (chunk == NULL) return NULL;
+
+  chunk->arena = arena;
+  chunk->capacity = capacity;
+  chunk->mapped = 0;
+  arena->stats.chunks++;
+  arena->stats.bytes_reserved += sizeof(struct ArenaChunk) + capacity;
+  return chunk;
+}
+
+/// Maps a chunk for a single large block. The kernel hands out zero pages on first touch, so mapping
+/// takes the same time whatever the size, and only the pages actually written to become resident.
+/// @note Must be called with the arena's mutex held.
+/// @return Newly mapped chunk, NULL on failure.
+static struct ArenaChunk* arena_chunk_map(struct Arena* arena, size_t capacity) {
+  size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+  size_t prefix = sizeof(struct ArenaChunk) + sizeof(struct ArenaHeader);  // Bytes before the block itself
+  size_t size = sizeof(struct ArenaChunk) + capacity;
+
+  // A huge page only backs a 2 MiB-aligned range, so a block that could use one starts on a 2 MiB boundary,
+  // with the chunk and block headers on the page just before it. The mapping is made 2 MiB larger than
+  // needed to find such a boundary, and the pages left over on either side are unmapped again.
+  int align = arena->huge_pages && capacity - sizeof(struct ArenaHeader) >= HUGE_PAGE_SIZE;
+  size_t mapping_size = align ? size + HUGE_PAGE_SIZE + page_size : size;
+  unsigned char* mapping = mmap(NULL, mapping_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) return NULL;
+
+  unsigned char* address = mapping;
+  if (align) {
+    uintptr_t block = ((uintptr_t)mapping + prefix + HUGE_PAGE_SIZE - 1) & ~(uintptr_t)(HUGE_PAGE_SIZE - 1);
+    address = (unsigned char*)(block - prefix);
+    unsigned char* start = (unsigned char*)((uintptr_t)address & ~(uintptr_t)(page_size - 1));
+    unsigned char* end = (unsigned char*)(((uintptr_t)address + size + page_size - 1) & ~(uintptr_t)(page_size - 1));
+    if (start > mapping) munmap(mapping, (size_t)(start - mapping));
+    if (end < mapping + mapping_size) munmap(end, (size_t)(mapping + mapping_size - end));
+    mapping = start;
+    mapping_size = (size_t)(end - start);
+  }
+#ifdef MADV_HUGEPAGE
+  // Only a hint: without transparent huge pages the mapping simply stays on regular pages
+  if (arena->huge_pages) madvise(mapping, mapping_size, MADV_HUGEPAGE);
+#endif
+
+  struct ArenaChunk* chunk = (struct ArenaChunk*)address;
+  chunk->arena = arena;
+  chunk->capacity = capacity;
+  chunk->mapped = 1;
+  chunk->mapping = mapping;
+  chunk->mapping_size = mapping_size;
+  arena->stats.chunks++;
+  arena->stats.bytes_reserved += mapping_size;
+  return chunk;
+}
+
+/// Gives a chunk back to the system.
+/// @note Must be called with the arena's mutex held, and with every block of the chunk freed.
+static void arena_chunk_release(struct Arena* arena, struct ArenaChunk* chunk) {
+  // Every block of a shared chunk sits in a free list by now, and must leave it before its bytes go away
+  if (!chunk->mapped) {
+    for (size_t offset = 0; offset < chunk->used;) {
+      struct ArenaHeader* header = (struct ArenaHeader*)(chunk->blocks + offset);
+      unlink_free_block(arena, header);
+      offset += header->size;
+    }
+  }
+
+  arena->stats.chunks--;
+  if (chunk->mapped) {
+    arena->stats.bytes_reserved -= chunk->mapping_size;
+    munmap(chunk->mapping, chunk->mapping_size);
+  } else {
+    arena->stats.bytes_reserved -= sizeof(struct ArenaChunk) + chunk->capacity;
+    free(chunk);
+  }
+}
+
+void* arena_alloc(struct Arena* arena, size_t size) {
+  size_t needed = align_up(sizeof(struct ArenaHeader) + align_up(size));
+  size_t class = size_class(needed);
+  if (class < ARENA_SIZE_CLASSES) needed = (size_t)ARENA_MIN_CLASS << class;
+
+  pthread_mutex_lock(&arena->mutex);
+
+  struct ArenaChunk* chunk;
+  struct ArenaHeader* header;
+  if (class == ARENA_SIZE_CLASSES) {
+    chunk = arena_chunk_map(arena, needed);
+    header = chunk != NULL ? (struct ArenaHeader*)chunk->blocks : NULL;
+    if (chunk != NULL) chunk->used = needed;
+  } else if (arena->free_blocks[class] != NULL) {
+    // A reused block still holds whatever its last owner left in it
+    header = (struct ArenaHeader*)((unsigned char*)arena->free_blocks[class] - sizeof(struct ArenaHeader));
+    unlink_free_block(arena, header);
+    memset((unsigned char*)header + sizeof(struct ArenaHeader), 0, needed - sizeof(struct ArenaHeader));
+    chunk = header->chunk;
+  } else {
+    chunk = arena->current;
+    if (chunk == NULL || chunk->capacity - chunk->used < needed) {
+      chunk = arena_chunk_create(arena, ARENA_CHUNK_SIZE);
+      if (chunk != NULL) {
+        // The previous chunk is released once its last block is freed, or right away if it is already empty
+        if (arena->current != NULL && arena->current->live == 0) {
+          arena_chunk_release(arena, arena->current);
+        }
+        arena->current = chunk;
+      }
+    }
+    // Bytes carved for the first time are still zeroed from the chunk allocation
+    header = chunk != NULL ? (struct ArenaHeader*)(chunk->blocks + chunk->used) : NULL;
+    if (chunk != NULL) chunk->used += needed;
+  }
+
+  if (chunk == NULL) {
+    pthread_mutex_unlock(&arena->mutex);
+    return NULL;
+  }
+
+  header->chunk = chunk;
+  header->size = needed;
+  chunk->live++;
+
+  arena->stats.live++;
+  arena->stats.bytes_in_use += needed;
+
+  pthread_mutex_unlock(&arena->mutex);
+  return (unsigned char*)header + sizeof(struct ArenaHeader);
+}
+
+void arena_free(void* block) {
+  if (block == NULL) return;
+
+  struct ArenaHeader* header = (struct ArenaHeader*)((unsigned char*)block - sizeof(struct ArenaHeader));
+  struct ArenaChunk* chunk = header->chunk;
+  struct Arena* arena = chunk->arena;
+
+  pthread_mutex_lock(&arena->mutex);
+  arena->stats.live--;
+  arena->stats.bytes_in_use -= header->size;
+  if (!chunk->mapped) push_free_block(arena, header);
+  if (--chunk->live == 0 && chunk != arena->current) {
+    arena_chunk_release(arena, chunk);
+  }
+  pthread_mutex_unlock(&arena->mutex);
+}
+
+void arena_destroy(struct Arena* arena) {
+  if (arena->current != NULL) {
+    arena_chunk_release(arena, arena->current);
+    arena->current = NULL;
+  }
+  pthread_mutex_destroy(&arena->mutex);
+}
+
+/// Lets the next thread that needs a cache adopt the cache of an exiting thread.
+static void release_cache(void* arg) {
+  struct ThreadCache* cache = arg;
+  atomic_store(&cache->in_use, false);
+}
+
+int thread_slab_init(struct ThreadSlab* slab) {
+  if (pthread_key_create(&slab->key, release_cache) != 0) return 1;
+  atomic_init(&slab->caches, NULL);
+  return 0;
+}
+
+/// Gets the cache of the calling thread, adopting a released one or creating one on first use.
+/// @return Cache of the calling thread, NULL on failure.
+static struct ThreadCache* own_cache(struct ThreadSlab* slab) {
+  struct ThreadCache* cache = pthread_getspecific(slab->key);
+  if (cache != NULL) return cache;
+
+  for (cache = atomic_load(&slab->caches); cache != NULL; cache = cache->next) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&cache->in_use, &expected, true)) break;
+  }
+
+  if (cache == NULL) {
+    cache = calloc(1, sizeof(struct ThreadCache));
+    if (cache == NULL) return NULL;
+    cache->slab = slab;
+    atomic_init(&cache->in_use, true);
+    atomic_init(&cache->remote_blocks, NULL);
+    atomic_init(&cache->num_chunks, 0);
+    atomic_init(&cache->bytes_reserved, 0);
+    atomic_init(&cache->bytes_in_use, 0);
+    atomic_init(&cache->live, 0);
+    cache->next = atomic_load(&slab->caches);
+    while (!atomic_compare_exchange_weak(&slab->caches, &cache->next, cache))
+      ;
+  }
+
+  if (pthread_setspecific(slab->key, cache) != 0) {
+    atomic_store(&cache->in_use, false);
+    return NULL;
+  }
+  return cache;
+}
+
+/// Adds to a statistic of a cache.
+/// @note Must be called by the owner of the cache, the only thread writing its statistics.
+static void add_stat(atomic_size_t* stat, size_t delta) {
+  atomic_store_explicit(stat, atomic_load_explicit(stat, memory_order_relaxed) + delta, memory_order_relaxed);
+}
+
+/// Gets the free block overlaying the bytes of a thread slab block.
+static struct ThreadFreeBlock* thread_free_block_of(struct ThreadHeader* header) {
+  return (struct ThreadFreeBlock*)((unsigned char*)header + sizeof(struct ThreadHeader));
+}
+
+/// Pushes a block onto the free list of its class.
+/// @note Must be called by the owner of the cache.
+static void push_thread_block(struct ThreadCache* cache, struct ThreadHeader* header) {
+  struct ThreadFreeBlock* block = thread_free_block_of(header);
+  block->next = cache->free_blocks[header->size_class];
+  cache->free_blocks[header->size_class] = block;
+  add_stat(&cache->live, (size_t)-1);
+  add_stat(&cache->bytes_in_use, -((size_t)THREAD_SLAB_MIN_CLASS << header->size_class));
+}
+
+/// Takes back every block other threads freed, sorting them into the free lists of their classes.
+/// @note Must be called by the owner of the cache. The whole stack is taken at once, so a block popped by the
+/// owner can never be pushed back underneath it.
+static void take_remote_blocks(struct ThreadCache* cache) {
+  struct ThreadFreeBlock* block = atomic_exchange_explicit(&cache->remote_blocks, NULL, memory_order_acquire);
+  while (block != NULL) {
+    struct ThreadFreeBlock* next = block->next;
+    push_thread_block(cache, (struct ThreadHeader*)((unsigned char*)block - sizeof(struct ThreadHeader)));
+    block = next;
+  }
+}
+
+void* thread_slab_alloc(struct ThreadSlab* slab, size_t size) {
+  size_t needed = align_up(sizeof(struct ThreadHeader) + align_up(size));
+  size_t class = 0;
+  while (class < THREAD_SLAB_SIZE_CLASSES && ((size_t)THREAD_SLAB_MIN_CLASS << class) < needed) class++;
+  if (class == THREAD_SLAB_SIZE_CLASSES) return NULL;
+  needed = (size_t)THREAD_SLAB_MIN_CLASS << class;
+
+  struct ThreadCache* cache = own_cache(slab);
+  if (cache == NULL) return NULL;
+
+  if (cache->free_blocks[class] == NULL) take_remote_blocks(cache);
+
+  struct ThreadHeader* header;
+  if (cache->free_blocks[class] != NULL) {
+    struct ThreadFreeBlock* block = cache->free_blocks[class];
+    cache->free_blocks[class] = block->next;
+    header = (struct ThreadHeader*)((unsigned char*)block - sizeof(struct ThreadHeader));
+  } else {
+    // The tail of a chunk too short for the block is left unused
+    if (cache->chunks == NULL || THREAD_SLAB_CHUNK_SIZE - cache->used < needed) {
+      struct SlabChunk* chunk = malloc(sizeof(struct SlabChunk) + THREAD_SLAB_CHUNK_SIZE);
+      if (chunk == NULL) return NULL;
+      chunk->next = cache->chunks;
+      cache->chunks = chunk;
+      cache->used = 0;
+      add_stat(&cache->num_chunks, 1);
+      add_stat(&cache->bytes_reserved, sizeof(struct SlabChunk) + THREAD_SLAB_CHUNK_SIZE);
+    }
+    header = (struct ThreadHeader*)(cache->chunks->objects + cache->used);
+    cache->used += needed;
+    header->cache = cache;
+    header->size_class = class;
+  }
+
+  add_stat(&cache->live, 1);
+  add_stat(&cache->bytes_in_use, needed);
+  return (unsigned char*)header + sizeof(struct ThreadHeader);
+}
+
+void thread_slab_free(void* block) {
+  if (block == NULL) return;
+
+  struct ThreadHeader* header = (struct ThreadHeader*)((unsigned char*)block - sizeof(struct ThreadHeader));
+  struct ThreadCache* cache = header->cache;
+  if (pthread_getspecific(cache->slab->key) == cache) {
+    push_thread_block(cache, header);
+    return;
+  }
+
+  struct ThreadFreeBlock* free_block = thread_free_block_of(header);
+  free_block->next = atomic_load_explicit(&cache->remote_blocks, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(&cache->remote_blocks, &free_block->next, free_block,
+                                                memory_order_release, memory_order_relaxed))
+    ;
+}
+
+void thread_slab_destroy(struct ThreadSlab* slab) {
+  pthread_key_delete(slab->key);
+  struct ThreadCache* cache = atomic_load(&slab->caches);
+  while (cache != NULL) {
+    struct ThreadCache* next = cache->next;
+    while (cache->chunks != NULL) {
+      struct SlabChunk* chunk = cache->chunks;
+      cache->chunks = chunk->next;
+      free(chunk);
+    }
+    free(cache);
+    cache = next;
+  }
+  atomic_store(&slab->caches, NULL);
+}
+
+void slab_stats(struct Slab* slab, struct AllocatorStats* stats) {
+  pthread_mutex_lock(&slab->mutex);
+  *stats = slab->stats;
+  pthread_mutex_unlock(&slab->mutex);
+}
+
+void arena_stats(struct Arena* arena, struct AllocatorStats* stats) {
+  pthread_mutex_lock(&arena->mutex);
+  *stats = arena->stats;
+  pthread_mutex_unlock(&arena->mutex);
+}
+
+void thread_slab_stats(struct ThreadSlab* slab, struct AllocatorStats* stats) {
+  memset(stats, 0, sizeof(*stats));
+  for (struct ThreadCache* cache = atomic_load(&slab->caches); cache != NULL; cache = cache->next) {
+    stats->chunks += atomic_load_explicit(&cache->num_chunks, memory_order_relaxed);
+    stats->bytes_reserved += atomic_load_explicit(&cache->bytes_reserved, memory_order_relaxed);
+    stats->bytes_in_use += atomic_load_explicit(&cache->bytes_in_use, memory_order_relaxed);
+    stats->live += atomic_load_explicit(&cache->live, memory_order_relaxed);
+  }
+}
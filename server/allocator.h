@@ -0,0 +1,138 @@
+#ifndef SERVER_ALLOCATOR_H
+#define SERVER_ALLOCATOR_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Usage statistics of an allocator
+struct AllocatorStats {
+  size_t chunks;          // Number of chunks obtained from the system
+  size_t bytes_reserved;  // Bytes obtained from the system
+  size_t bytes_in_use;    // Bytes handed out and not yet freed
+  size_t live;            // Number of allocations not yet freed
+};
+
+struct SlabChunk;
+
+// Allocator of fixed-size objects, carved out of large chunks and recycled through a free list
+struct Slab {
+  size_t object_size;        // Size of each object (rounded up to the allocation alignment)
+  size_t objects_per_chunk;  // Number of objects carved out of each chunk
+  void* free_objects;        // Free list of objects, linked through their first word
+  struct SlabChunk* chunks;  // Every chunk of the slab
+  struct AllocatorStats stats;
+  pthread_mutex_t mutex;
+};
+
+struct ArenaChunk;
+struct ArenaFreeBlock;
+
+#define ARENA_SIZE_CLASSES 13  // Block sizes shared by the blocks of a chunk: 32 B to 128 KiB, in powers of two
+
+// Allocator of variable-size blocks. Blocks are rounded up to a size class and carved out of chunks, and a
+// freed block goes to the free list of its class, so the next block of that class reuses its bytes. A chunk
+// is given back to the system as soon as every block carved out of it has been freed. Blocks too large for
+// a size class get an anonymous mapping of their own, so they cost nothing until their pages are written to.
+struct Arena {
+  struct ArenaChunk* current;  // Chunk new blocks are carved out of when their class has no free block
+  struct ArenaFreeBlock* free_blocks[ARENA_SIZE_CLASSES];  // Freed blocks of each class, ready for reuse
+  int huge_pages;              // Whether large blocks ask for transparent huge pages
+  struct AllocatorStats stats;
+  pthread_mutex_t mutex;
+};
+
+struct ThreadCache;
+
+#define THREAD_SLAB_SIZE_CLASSES 8  // Block sizes of a thread slab: 32 B to 4 KiB, in powers of two
+
+// Allocator of small variable-size blocks that takes no lock to allocate or free. Each thread carves blocks
+// out of chunks of its own and keeps the blocks it frees in its own free lists. A block freed by another
+// thread is pushed onto a lock-free stack of the thread that carved it, which takes the whole stack back once
+// its free lists run dry. The cache of a thread that exits is adopted by the next thread that needs one.
+struct ThreadSlab {
+  _Atomic(struct ThreadCache*) caches;  // Every cache of the slab, including those of exited threads
+  pthread_key_t key;                    // Cache of the calling thread
+};
+
+/// Initializes a slab.
+/// @param slab Slab to be initialized.
+/// @param object_size Size of the objects handed out by the slab.
+/// @param objects_per_chunk Number of objects carved out of each chunk.
+/// @return 0 if the slab was initialized successfully, 1 otherwise.
+int slab_init(struct Slab* slab, size_t object_size, size_t objects_per_chunk);
+
+/// Allocates an object from a slab.
+/// @param slab Slab to allocate from.
+/// @return Pointer to an uninitialized object, NULL on failure.
+void* slab_alloc(struct Slab* slab);
+
+/// Gives an object back to its slab.
+/// @param slab Slab the object was allocated from.
+/// @param object Object to be freed.
+void slab_free(struct Slab* slab, void* object);
+
+/// Releases every chunk of a slab, including the objects still in use.
+/// @param slab Slab to be destroyed.
+void slab_destroy(struct Slab* slab);
+
+/// Initializes an arena.
+/// @param arena Arena to be initialized.
+/// @param huge_pages Whether to back large blocks with transparent huge pages when available.
+/// @return 0 if the arena was initialized successfully, 1 otherwise.
+int arena_init(struct Arena* arena, int huge_pages);
+
+/// Allocates a zeroed block from an arena.
+/// @param arena Arena to allocate from.
+/// @param size Size of the block.
+/// @return Pointer to the block, NULL on failure.
+void* arena_alloc(struct Arena* arena, size_t size);
+
+/// Gives a block back to the arena it was allocated from.
+/// @note Takes a single argument so it can be used as an epoch release function.
+/// @param block Block to be freed (may be NULL).
+void arena_free(void* block);
+
+/// Destroys an arena.
+/// @note Every block must have been freed already.
+/// @param arena Arena to be destroyed.
+void arena_destroy(struct Arena* arena);
+
+/// Initializes a thread slab.
+/// @param slab Thread slab to be initialized.
+/// @return 0 if the slab was initialized successfully, 1 otherwise.
+int thread_slab_init(struct ThreadSlab* slab);
+
+/// Allocates a block from the calling thread's cache of a thread slab.
+/// @param slab Thread slab to allocate from.
+/// @param size Size of the block (at most what the largest class holds).
+/// @return Pointer to an uninitialized block, NULL on failure.
+void* thread_slab_alloc(struct ThreadSlab* slab, size_t size);
+
+/// Gives a block back to the cache it was allocated from.
+/// @note May be called from any thread. Takes a single argument so it can be used as an epoch release function.
+/// @param block Block to be freed (may be NULL).
+void thread_slab_free(void* block);
+
+/// Releases every chunk of a thread slab, including the blocks still in use.
+/// @note No thread may use the slab anymore.
+/// @param slab Thread slab to be destroyed.
+void thread_slab_destroy(struct ThreadSlab* slab);
+
+/// Gets the usage statistics of a slab.
+/// @param slab Slab to get the statistics of.
+/// @param stats Pointer to store the statistics in.
+void slab_stats(struct Slab* slab, struct AllocatorStats* stats);
+
+/// Gets the usage statistics of an arena.
+/// @param arena Arena to get the statistics of.
+/// @param stats Pointer to store the statistics in.
+void arena_stats(struct Arena* arena, struct AllocatorStats* stats);
+
+/// Gets the usage statistics of a thread slab, summed over the caches of every thread.
+/// @note Blocks freed by another thread count as in use until their cache takes them back.
+/// @param slab Thread slab to get the statistics of.
+/// @param stats Pointer to store the statistics in.
+void thread_slab_stats(struct ThreadSlab* slab, struct AllocatorStats* stats);
+
+#endif  // SERVER_ALLOCATOR_H
@@ -0,0 +1,177 @@
+#include "epoch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// Each thread announces the epoch it is reading in through a record of its own.
+// The state is (epoch << 1) | 1 while inside a critical section and 0 outside of one.
+struct EpochRecord {
+  atomic_ulong state;
+  atomic_bool in_use;
+  struct EpochRecord *next;
+};
+
+struct RetiredObject {
+  void *ptr;
+  void (*release)(void *);
+  unsigned long epoch;  // Global epoch at the time the object was retired
+  struct RetiredObject *next;
+};
+
+static atomic_ulong global_epoch = 0;
+static _Atomic(struct EpochRecord *) records = NULL;
+
+static pthread_mutex_t retired_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct RetiredObject *retired = NULL;
+static atomic_size_t num_retired = 0;  // Objects in the retired list, so readers leaving check it without the lock
+static atomic_bool collect_requested = false;  // Set by a reader that left while the retired list was busy
+
+static pthread_once_t record_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t record_key;
+
+static _Thread_local struct EpochRecord *self = NULL;
+static _Thread_local unsigned int nesting = 0;
+
+/// Gives the record of an exiting thread back so another thread can reuse it.
+static void release_record(void *arg) {
+  struct EpochRecord *record = arg;
+  atomic_store(&record->state, 0);
+  atomic_store(&record->in_use, false);
+}
+
+static void create_record_key(void) {
+  if (pthread_key_create(&record_key, release_record) != 0) {
+    fprintf(stderr, "Error creating epoch record key\n");
+  }
+}
+
+/// Gets the record of the calling thread, registering the thread on first use.
+static struct EpochRecord *own_record(void) {
+  if (self != NULL) return self;
+
+  for (struct EpochRecord *record = atomic_load(&records); record != NULL; record = record->next) {
+    bool expected = false;
+    if (atomic_compare_exchange_strong(&record->in_use, &expected, true)) {
+      self = record;
+      break;
+    }
+  }
+
+  if (self == NULL) {
+    struct EpochRecord *record = malloc(sizeof(struct EpochRecord));
+    if (record == NULL) {
+      fprintf(stderr, "Error allocating memory for epoch record\n");
+      abort();
+    }
+    atomic_init(&record->state, 0);
+    atomic_init(&record->in_use, true);
+    record->next = atomic_load(&records);
+    while (!atomic_compare_exchange_weak(&records, &record->next, record))
+      ;
+    self = record;
+  }
+
+  pthread_once(&record_key_once, create_record_key);
+  pthread_setspecific(record_key, self);
+  return self;
+}
+
+void epoch_enter(void) {
+  if (nesting++ > 0) return;
+
+  struct EpochRecord *record = own_record();
+  atomic_store(&record->state, (atomic_load(&global_epoch) << 1) | 1);
+}
+
+/// Advances the global epoch if every active reader has caught up with it.
+/// @return The global epoch after the attempt.
+static unsigned long try_advance(void) {
+  unsigned long epoch = atomic_load(&global_epoch);
+
+  for (struct EpochRecord *record = atomic_load(&records); record != NULL; record = record->next) {
+    unsigned long state = atomic_load(&record->state);
+    if ((state & 1) && (state >> 1) != epoch) return epoch;
+  }
+
+  atomic_compare_exchange_strong(&global_epoch, &epoch, epoch + 1);
+  return atomic_load(&global_epoch);
+}
+
+/// Releases the retired objects that no reader can reference anymore.
+/// @note Must be called with retired_mutex held.
+static void collect(unsigned long epoch) {
+  struct RetiredObject **link = &retired;
+  while (*link != NULL) {
+    struct RetiredObject *object = *link;
+    // Two epoch advances guarantee every reader that could have seen the object has left
+    if (object->epoch + 2 <= epoch) {
+      *link = object->next;
+      atomic_fetch_sub(&num_retired, 1);
+      object->release(object->ptr);
+      free(object);
+    } else {
+      link = &object->next;
+    }
+  }
+}
+
+/// Advances the global epoch as far as the active readers allow and releases what that makes unreachable, then
+/// unlocks the retired list.
+/// @note Must be called with retired_mutex held. A reader that left while the list was held may have been the
+/// last one holding objects back, so its request is served here, after unlocking, rather than lost.
+static void collect_and_unlock(void) {
+  do {
+    atomic_store(&collect_requested, false);
+    // With no lagging readers, two advances are enough to release an object right away
+    try_advance();
+    collect(try_advance());
+    pthread_mutex_unlock(&retired_mutex);
+  } while (atomic_load(&collect_requested) && atomic_load(&num_retired) > 0 &&
+           pthread_mutex_trylock(&retired_mutex) == 0);
+}
+
+void epoch_exit(void) {
+  if (--nesting > 0) return;
+
+  atomic_store(&self->state, 0);
+
+  // Retired objects are released by the last reader that could reference them, so they never wait for a later
+  // retire. A reader finding the list busy leaves the collection to the thread holding it.
+  if (atomic_load(&num_retired) > 0) {
+    atomic_store(&collect_requested, true);
+    if (pthread_mutex_trylock(&retired_mutex) == 0) collect_and_unlock();
+  }
+}
+
+void epoch_retire(void *ptr, void (*release)(void *)) {
+  struct RetiredObject *object = malloc(sizeof(struct RetiredObject));
+  if (object == NULL) {
+    fprintf(stderr, "Error allocating memory for retired object\n");
+    abort();
+  }
+
+  object->ptr = ptr;
+  object->release = release;
+
+  pthread_mutex_lock(&retired_mutex);
+  object->epoch = atomic_load(&global_epoch);
+  object->next = retired;
+  retired = object;
+  atomic_fetch_add(&num_retired, 1);
+  collect_and_unlock();
+}
+
+void epoch_drain(void) {
+  pthread_mutex_lock(&retired_mutex);
+  while (retired != NULL) {
+    struct RetiredObject *object = retired;
+    retired = object->next;
+    atomic_fetch_sub(&num_retired, 1);
+    object->release(object->ptr);
+    free(object);
+  }
+  pthread_mutex_unlock(&retired_mutex);
+}
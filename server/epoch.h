@@ -0,0 +1,24 @@
+#ifndef SERVER_EPOCH_H
+#define SERVER_EPOCH_H
+
+/// Enters a read-side critical section.
+/// @note Any object reachable from shared state when the section starts stays allocated until epoch_exit.
+/// Sections may be nested; only the outermost exit ends the section.
+void epoch_enter(void);
+
+/// Leaves a read-side critical section.
+/// @note Leaving the outermost section releases the retired objects no section can reference anymore, so the
+/// last reader holding an object back releases it.
+void epoch_exit(void);
+
+/// Defers releasing an object until every read-side critical section that might still reference it has ended.
+/// @note The object must already be unreachable for new readers.
+/// @param ptr Object to be released.
+/// @param release Function used to release the object.
+void epoch_retire(void *ptr, void (*release)(void *));
+
+/// Releases every retired object right away.
+/// @note Must only be called when no thread is inside a read-side critical section.
+void epoch_drain(void);
+
+#endif  // SERVER_EPOCH_H
@@ -0,0 +1,185 @@
+#include "eventcache.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define CACHE_WAYS 8          // Events per set, the candidates for eviction when one more comes in
+#define STATS_FLUSH_EVERY 64  // Lookups a thread counts privately before publishing them
+
+// Events whose ids hash alike, evicted among themselves with the CLOCK algorithm.
+// Lookups only read the slots; inserting and evicting take the set's lock.
+struct CacheSet {
+  _Atomic(struct Event*) events[CACHE_WAYS];  // Cached events, NULL for free ways
+  atomic_bool referenced[CACHE_WAYS];         // Whether each event was used since the hand last passed it
+  unsigned int hand;                          // Next way considered for eviction
+  pthread_mutex_t lock;
+};
+
+static struct CacheSet* sets = NULL;
+static size_t num_sets = 0;  // Always a power of two, 0 while the cache is disabled
+
+static atomic_ulong total_hits = 0;
+static atomic_ulong total_misses = 0;
+static _Thread_local unsigned long local_hits = 0;
+static _Thread_local unsigned long local_misses = 0;
+
+/// Gets the set an event belongs to.
+/// @param event_id Event id.
+/// @return Set where the event is (or would be) cached.
+static struct CacheSet* set_of(unsigned int event_id) {
+  uint32_t h = event_id;
+  h ^= h >> 16;
+  h *= 0x7feb352du;
+  h ^= h >> 15;
+  h *= 0x846ca68bu;
+  h ^= h >> 16;
+  return &sets[(size_t)h & (num_sets - 1)];
+}
+
+/// Counts a lookup, publishing the calling thread's counts every STATS_FLUSH_EVERY lookups.
+/// @param hit Whether the lookup was served by the cache.
+static void count_lookup(bool hit) {
+  if (hit) {
+    local_hits++;
+  } else {
+    local_misses++;
+  }
+
+  if (local_hits + local_misses >= STATS_FLUSH_EVERY) {
+    atomic_fetch_add_explicit(&total_hits, local_hits, memory_order_relaxed);
+    atomic_fetch_add_explicit(&total_misses, local_misses, memory_order_relaxed);
+    local_hits = local_misses = 0;
+  }
+}
+
+int event_cache_init(size_t capacity) {
+  if (sets != NULL) {
+    fprintf(stderr, "Event cache has already been initialized\n");
+    return 1;
+  }
+  if (capacity == 0) return 0;
+
+  size_t count = 1;
+  while (count * CACHE_WAYS < capacity) count <<= 1;
+
+  sets = calloc(count, sizeof(struct CacheSet));
+  if (sets == NULL) {
+    fprintf(stderr, "Error allocating memory for event cache\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (pthread_mutex_init(&sets[i].lock, NULL) != 0) {
+      fprintf(stderr, "Error initializing event cache lock\n");
+      while (i > 0) pthread_mutex_destroy(&sets[--i].lock);
+      free(sets);
+      sets = NULL;
+      return 1;
+    }
+  }
+
+  num_sets = count;
+  atomic_store(&total_hits, 0);
+  atomic_store(&total_misses, 0);
+  return 0;
+}
+
+void event_cache_destroy(void) {
+  for (size_t i = 0; i < num_sets; i++) {
+    pthread_mutex_destroy(&sets[i].lock);
+  }
+  free(sets);
+  sets = NULL;
+  num_sets = 0;
+}
+
+struct Event* event_cache_get(unsigned int event_id) {
+  if (num_sets == 0) return NULL;
+
+  struct CacheSet* set = set_of(event_id);
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    struct Event* event = atomic_load_explicit(&set->events[way], memory_order_acquire);
+    if (event != NULL && event->id == event_id) {
+      // Only write the flag when it changes, so hits on a hot event do not keep bouncing its cache line
+      if (!atomic_load_explicit(&set->referenced[way], memory_order_relaxed)) {
+        atomic_store_explicit(&set->referenced[way], true, memory_order_relaxed);
+      }
+      count_lookup(true);
+      return event;
+    }
+  }
+
+  count_lookup(false);
+  return NULL;
+}
+
+bool event_cache_contains(unsigned int event_id) {
+  if (num_sets == 0) return false;
+
+  struct CacheSet* set = set_of(event_id);
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    struct Event* event = atomic_load_explicit(&set->events[way], memory_order_acquire);
+    if (event != NULL && event->id == event_id) return true;
+  }
+  return false;
+}
+
+void event_cache_put(struct Event* event) {
+  if (num_sets == 0) return;
+
+  struct CacheSet* set = set_of(event->id);
+  pthread_mutex_lock(&set->lock);
+
+  // The deleter marks the event before evicting it under this lock, so either it evicts what is inserted
+  // here or the mark is seen here
+  if (atomic_load(&event->deleted)) {
+    pthread_mutex_unlock(&set->lock);
+    return;
+  }
+
+  int victim = -1;
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    struct Event* cached = atomic_load_explicit(&set->events[way], memory_order_relaxed);
+    if (cached == event) {
+      pthread_mutex_unlock(&set->lock);
+      return;
+    }
+    if (cached == NULL && victim < 0) victim = way;
+  }
+
+  // No free way: the hand clears the referenced flags it passes and evicts the first event not used since
+  while (victim < 0) {
+    unsigned int way = set->hand;
+    set->hand = (set->hand + 1) % CACHE_WAYS;
+    if (!atomic_exchange_explicit(&set->referenced[way], false, memory_order_relaxed)) victim = (int)way;
+  }
+
+  // A new event starts unreferenced, so one seen only once is the first to go
+  atomic_store_explicit(&set->referenced[victim], false, memory_order_relaxed);
+  atomic_store_explicit(&set->events[victim], event, memory_order_release);
+  pthread_mutex_unlock(&set->lock);
+}
+
+void event_cache_remove(struct Event* event) {
+  if (num_sets == 0) return;
+
+  struct CacheSet* set = set_of(event->id);
+  pthread_mutex_lock(&set->lock);
+  for (int way = 0; way < CACHE_WAYS; way++) {
+    if (atomic_load_explicit(&set->events[way], memory_order_relaxed) == event) {
+      atomic_store_explicit(&set->events[way], NULL, memory_order_release);
+      atomic_store_explicit(&set->referenced[way], false, memory_order_relaxed);
+    }
+  }
+  pthread_mutex_unlock(&set->lock);
+}
+
+void event_cache_stats(struct EventCacheStats* stats) {
+  stats->capacity = num_sets * CACHE_WAYS;
+  stats->hits = atomic_load_explicit(&total_hits, memory_order_relaxed);
+  stats->misses = atomic_load_explicit(&total_misses, memory_order_relaxed);
+}
@@ -0,0 +1,53 @@
+#ifndef SERVER_EVENT_CACHE_H
+#define SERVER_EVENT_CACHE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "eventlist.h"
+
+// Effectiveness of the event cache
+struct EventCacheStats {
+  size_t capacity;       // Number of events the cache holds at most
+  unsigned long hits;    // Lookups served by the cache
+  unsigned long misses;  // Lookups that went to the registry
+};
+
+/// Sets up the event cache.
+/// @note The cache only holds handles to events in the registry; it never owns or frees them.
+/// @param capacity Number of events the cache holds at most, rounded up to a whole number of sets (0 disables it).
+/// @return 0 if the cache was set up successfully, 1 otherwise.
+int event_cache_init(size_t capacity);
+
+/// Frees the event cache.
+/// @note Must only be called when no thread uses the cache.
+void event_cache_destroy(void);
+
+/// Looks an event up in the cache, marking it as recently used.
+/// @note Takes no lock: must be called inside an epoch read-side section (or with the event's shard locked).
+/// @param event_id Id of the event.
+/// @return Pointer to the event if cached, NULL otherwise.
+struct Event* event_cache_get(unsigned int event_id);
+
+/// Checks whether an event is cached, without counting a lookup or marking the event as recently used.
+/// @note Takes no lock: must be called inside an epoch read-side section (or with the event's shard locked).
+/// @param event_id Id of the event.
+/// @return Whether the event is cached.
+bool event_cache_contains(unsigned int event_id);
+
+/// Caches an event just looked up in the registry, evicting the least recently used event of its set if full.
+/// @note Does nothing if the event is being deleted, so a deleted event is never cached again.
+/// @param event Event to be cached.
+void event_cache_put(struct Event* event);
+
+/// Evicts an event from the cache.
+/// @note Must be called after marking the event as deleted and before it is removed from the registry.
+/// @param event Event to be evicted.
+void event_cache_remove(struct Event* event);
+
+/// Gets the statistics of the event cache.
+/// @note Hits and misses are counted per thread and published in batches, so they may lag slightly.
+/// @param stats Pointer to store the statistics in.
+void event_cache_stats(struct EventCacheStats* stats);
+
+#endif  // SERVER_EVENT_CACHE_H
@@ -1,27 +1,122 @@
 #include "eventlist.h"
 
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 
+#include "common/constants.h"
+#include "epoch.h"
+
+#define INITIAL_INDEX_CAPACITY 64
+#define SLAB_OBJECTS_PER_CHUNK 256
+
+/// Hashes an event id into a slot of an index with the given capacity.
+/// @param event_id Event id.
+/// @param capacity Number of slots of the index (a power of two).
+/// @return Slot where the probe sequence for the id starts.
+static size_t index_slot(unsigned int event_id, size_t capacity) {
+  uint32_t h = event_id;
+  h ^= h >> 16;
+  h *= 0x85ebca6bu;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35u;
+  h ^= h >> 16;
+  return (size_t)h & (capacity - 1);
+}
+
+// Marks index slots of removed events, so lookups keep probing past them
+static struct ListNode tombstone;
+
+/// Allocates an empty index.
+/// @param capacity Number of slots of the index (a power of two).
+/// @return Newly allocated index, NULL on failure.
+static struct EventIndex* index_create(size_t capacity) {
+  struct EventIndex* index = malloc(sizeof(struct EventIndex) + capacity * sizeof(_Atomic(struct ListNode*)));
+  if (!index) return NULL;
+  index->capacity = capacity;
+  for (size_t i = 0; i < capacity; i++) {
+    atomic_init(&index->slots[i], NULL);
+  }
+  return index;
+}
+
+/// Places a node in the first free (or tombstone) slot of its probe sequence.
+/// @note The index must have at least one free slot. The node is published with release semantics,
+/// so a lookup that finds it also sees it and its event fully initialized.
+/// @return 1 if a tombstone was reused, 0 otherwise.
+static int index_place(struct EventIndex* index, struct ListNode* node) {
+  size_t slot = index_slot(node->event->id, index->capacity);
+  struct ListNode* current;
+  while ((current = atomic_load_explicit(&index->slots[slot], memory_order_relaxed)) != NULL && current != &tombstone) {
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  atomic_store_explicit(&index->slots[slot], node, memory_order_release);
+  return current == &tombstone;
+}
+
+/// Replaces the index by one with the given capacity, holding only the events still in the list.
+/// @note The old index is retired through the epoch, since lookups may still be probing it.
+/// @return 0 if the index was rebuilt successfully, 1 otherwise.
+static int index_rebuild(struct EventList* list, size_t capacity) {
+  struct EventIndex* old = atomic_load_explicit(&list->index, memory_order_relaxed);
+  struct EventIndex* index = index_create(capacity);
+  if (!index) return 1;
+
+  for (struct ListNode* current = list->head; current != NULL; current = current->next) {
+    index_place(index, current);
+  }
+
+  atomic_store_explicit(&list->index, index, memory_order_release);
+  list->tombstones = 0;
+  epoch_retire(old, free);
+  return 0;
+}
+
 struct EventList* create_list() {
   struct EventList* list = (struct EventList*)malloc(sizeof(struct EventList));
   if (!list) return NULL;
+  struct EventIndex* index = index_create(INITIAL_INDEX_CAPACITY);
+  if (!index) {
+    free(list);
+    return NULL;
+  }
   if (pthread_rwlock_init(&list->rwl, NULL) != 0) {
+    free(index);
+    free(list);
+    return NULL;
+  }
+  if (slab_init(&list->event_slab, sizeof(struct Event), SLAB_OBJECTS_PER_CHUNK) != 0 ||
+      slab_init(&list->node_slab, sizeof(struct ListNode), SLAB_OBJECTS_PER_CHUNK) != 0 ||
+      arena_init(&list->seat_arena, SEAT_MAP_HUGE_PAGES) != 0) {
+    pthread_rwlock_destroy(&list->rwl);
+    free(index);
     free(list);
     return NULL;
   }
   list->head = NULL;
   list->tail = NULL;
+  atomic_init(&list->index, index);
+  list->size = 0;
+  list->tombstones = 0;
   return list;
 }
 
 int append_to_list(struct EventList* list, struct Event* event) {
   if (!list) return 1;
 
-  struct ListNode* new_node = (struct ListNode*)malloc(sizeof(struct ListNode));
+  // Keep the load factor (tombstones included) at or below 1/2 so probe sequences stay short.
+  // Rebuilding drops the tombstones, so the index only doubles when the live events need it.
+  size_t capacity = atomic_load_explicit(&list->index, memory_order_relaxed)->capacity;
+  if ((list->size + list->tombstones + 1) * 2 > capacity &&
+      index_rebuild(list, (list->size + 1) * 4 > capacity ? capacity * 2 : capacity) != 0)
+    return 1;
+
+  struct ListNode* new_node = slab_alloc(&list->node_slab);
   if (!new_node) return 1;
 
   new_node->event = event;
+  new_node->list = list;
+  new_node->prev = list->tail;
   new_node->next = NULL;
 
   if (list->head == NULL) {
@@ -32,13 +127,85 @@ int append_to_list(struct EventList* list, struct Event* event) {
     list->tail = new_node;
   }
 
+  if (index_place(atomic_load_explicit(&list->index, memory_order_relaxed), new_node)) {
+    list->tombstones--;
+  }
+  list->size++;
+
   return 0;
 }
 
-static void free_event(struct Event* event) {
+struct Event* alloc_event(struct EventList* list) { return slab_alloc(&list->event_slab); }
+
+void free_event(struct EventList* list, struct Event* event) {
   if (!event) return;
-  free(event->data);
-  free(event);
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    pthread_mutex_destroy(&event->stripes[i]);
+  }
+  for (size_t segment = 0; segment < RESERVATION_SEGMENTS; segment++) {
+    _Atomic(struct SeatList*)* entries = atomic_load(&event->reservation_segments[segment]);
+    if (entries == NULL) continue;
+    for (size_t i = 0; i < (size_t)RESERVATION_SEGMENT_SIZE << segment; i++) {
+      thread_slab_free(atomic_load(&entries[i]));
+    }
+    arena_free(entries);
+  }
+  struct SeatUndo* undo = atomic_load(&event->undo);
+  while (undo != NULL) {
+    struct SeatUndo* next = atomic_load(&undo->next);
+    arena_free(undo);
+    undo = next;
+  }
+  arena_free(event->stripes);
+  arena_free(event->row_free);
+  arena_free(event->occupied);
+  arena_free(event->data);
+  slab_free(&list->event_slab, event);
+}
+
+/// Frees a node that was removed from its list, along with its event.
+static void release_node(void* arg) {
+  struct ListNode* node = arg;
+  free_event(node->list, node->event);
+  slab_free(&node->list->node_slab, node);
+}
+
+int remove_from_list(struct EventList* list, unsigned int event_id) {
+  if (!list) return 1;
+
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_relaxed);
+  size_t slot = index_slot(event_id, index->capacity);
+  struct ListNode* node;
+  while ((node = atomic_load_explicit(&index->slots[slot], memory_order_relaxed)) != NULL) {
+    if (node != &tombstone && node->event->id == event_id) break;
+    slot = (slot + 1) & (index->capacity - 1);
+  }
+  if (node == NULL) return 1;
+
+  // Readers probing this slot must keep going, so it becomes a tombstone rather than a free slot
+  atomic_store_explicit(&index->slots[slot], &tombstone, memory_order_release);
+  list->tombstones++;
+  list->size--;
+
+  if (node->prev != NULL) {
+    node->prev->next = node->next;
+  } else {
+    list->head = node->next;
+  }
+  if (node->next != NULL) {
+    node->next->prev = node->prev;
+  } else {
+    list->tail = node->prev;
+  }
+
+  epoch_retire(node, release_node);
+
+  // Shrink the index once most of it is empty, so a registry that had many events gives the memory back
+  if (index->capacity > INITIAL_INDEX_CAPACITY && list->size * 8 < index->capacity) {
+    index_rebuild(list, index->capacity / 2);
+  }
+
+  return 0;
 }
 
 void free_list(struct EventList* list) {
@@ -49,26 +216,29 @@ void free_list(struct EventList* list) {
     struct ListNode* temp = current;
     current = current->next;
 
-    free_event(temp->event);
-    free(temp);
+    free_event(list, temp->event);
   }
 
+  slab_destroy(&list->event_slab);
+  slab_destroy(&list->node_slab);
+  arena_destroy(&list->seat_arena);
+  free(atomic_load(&list->index));
   free(list);
 }
 
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  if (!list || !from || !to) return NULL;
-  struct ListNode* current = from;
-
-  while (1) {
-    if (current->event->id == event_id) {
-      return current->event;
-    }
+struct Event* get_event(struct EventList* list, unsigned int event_id) {
+  if (!list) return NULL;
 
-    if (current == to) {
-      return NULL;
+  struct EventIndex* index = atomic_load_explicit(&list->index, memory_order_acquire);
+  size_t slot = index_slot(event_id, index->capacity);
+  struct ListNode* node;
+  while ((node = atomic_load_explicit(&index->slots[slot], memory_order_acquire)) != NULL) {
+    if (node != &tombstone && node->event->id == event_id) {
+      return node->event;
     }
 
-    current = current->next;
+    slot = (slot + 1) & (index->capacity - 1);
   }
+
+  return NULL;
 }
@@ -2,29 +2,97 @@
 #define SERVER_EVENT_LIST_H
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "allocator.h"
+
+#define RESERVATION_SEGMENT_SIZE 64  // Entries of the first segment of an event's reservation index
+#define RESERVATION_SEGMENTS 27      // Segments of a reservation index, each twice the one before: room for any id
+
+struct Hold;
+struct ReserveRequest;
+
+// Seats held by one reservation
+struct SeatList {
+  _Atomic(struct Hold*) hold;  // Expiry of the reservation while it is only held, NULL once it is a real one
+  size_t num_seats;
+  size_t seats[];  // Indexes of the seats in Event::data
+};
+
+// Previous value of a seat
+struct SeatValue {
+  size_t index;        // Index of the seat in Event::data
+  unsigned int value;  // Id of the reservation that held the seat, 0 if it was free
+};
+
+// Seats overwritten by one write, kept while a report older than the write may need to undo it
+struct SeatUndo {
+  unsigned long version;           // Version of the write
+  _Atomic(struct SeatUndo*) next;  // Record of an earlier write
+  size_t num_seats;
+  struct SeatValue seats[];  // Seats as they were before the write
+};
 
 struct Event {
   unsigned int id;            /// Event id
-  unsigned int reservations;  /// Number of reservations for the event.
+  atomic_uint reservations;   /// Number of reservations for the event.
+  unsigned long seq;          /// Creation order of the event across the whole registry.
 
   size_t cols;  /// Number of columns.
   size_t rows;  /// Number of rows.
 
-  unsigned int* data;     /// Array of size rows * cols with the reservations for each seat.
-  pthread_mutex_t mutex;  // Mutex to protect the event
+  _Atomic(void*) data;        /// Array of size rows * cols with the reservations for each seat.
+  atomic_uint seat_width;     /// Bytes per seat in data (1, 2 or 4), widened once reservation ids outgrow it.
+  _Atomic uint64_t seat_seq;  /// Seqlock of data: writers in progress in the low 32 bits, finished writes above.
+  atomic_uint snapshot_waiters;  /// Snapshots holding new writers of data off, after giving up on the seqlock.
+  _Atomic(struct SeatUndo*) undo;  /// Undo records of the writes to data while reports are taken, newest first.
+  _Atomic uint64_t* occupied;  /// Bitmap of the reserved seats, each row padded to a whole number of words.
+  size_t row_words;       /// Number of bitmap words per row.
+  atomic_size_t* row_free;   /// Number of free seats of each row, kept along with the bitmap.
+  atomic_size_t free_count;  /// Number of free seats of the whole event.
+
+  pthread_mutex_t* stripes;  /// Locks protecting the seats, one per stripe of consecutive rows.
+  size_t num_stripes;        /// Number of stripes (at most MAX_SEAT_STRIPES).
+  size_t rows_per_stripe;    /// Number of rows covered by each stripe.
+
+  /// Seats of each reservation, indexed by id (NULL once cancelled), in segments installed as ids reach them.
+  _Atomic(_Atomic(struct SeatList*)*) reservation_segments[RESERVATION_SEGMENTS];
+
+  _Atomic(struct ReserveRequest*) reserve_queue;  /// Reservations waiting for a combiner, newest first.
+  atomic_bool combining;                          /// Whether a requester is applying the queued reservations.
+
+  atomic_bool deleted;  /// Set once the event is being deleted, so the event cache no longer takes it.
 };
 
 struct ListNode {
   struct Event* event;
+  struct EventList* list;  // List the node (and its event's memory) belongs to
+  struct ListNode* prev;
   struct ListNode* next;
 };
 
+// Open-addressing hash table of the list nodes, keyed by event id
+struct EventIndex {
+  size_t capacity;                    // Number of slots (always a power of two)
+  _Atomic(struct ListNode*) slots[];  // Nodes, NULL for free slots
+};
+
 // Linked list structure
 struct EventList {
   struct ListNode* head;  // Head of the list
   struct ListNode* tail;  // Tail of the list
-  pthread_rwlock_t rwl;   // Mutex to protect the list
+
+  _Atomic(struct EventIndex*) index;  // Index of the events, replaced as a whole when it grows
+  size_t size;                        // Number of events in the list
+  size_t tombstones;                  // Number of index slots left behind by removed events
+
+  struct Slab event_slab;   // Memory of the events
+  struct Slab node_slab;    // Memory of the list nodes
+  struct Arena seat_arena;  // Memory of the seats, bitmaps and locks of the events
+
+  pthread_rwlock_t rwl;  // Serializes writers of the list; lookups through the index do not take it
 };
 
 /// Creates a new event list.
@@ -37,17 +105,36 @@ struct EventList* create_list();
 /// @return 0 if the node was appended successfully, 1 otherwise.
 int append_to_list(struct EventList* list, struct Event* data);
 
-/// Removes a node from the list.
+/// Removes the node of an event from the list.
+/// @note The node and its event are released through the epoch, so readers still holding the event
+/// can keep using it until they leave their read-side section.
 /// @param list Event list to be modified.
+/// @param event_id Id of the event to be removed.
 /// @return 0 if the node was removed successfully, 1 otherwise.
+int remove_from_list(struct EventList* list, unsigned int event_id);
+
+/// Allocates an uninitialized event from the list's memory.
+/// @note Its seats, bitmap and locks must be allocated from list->seat_arena.
+/// @param list Event list the event will be appended to.
+/// @return Pointer to the event, NULL on failure.
+struct Event* alloc_event(struct EventList* list);
+
+/// Frees an event, its seats and its locks.
+/// @param list Event list the event's memory comes from.
+/// @param event Event to be freed.
+void free_event(struct EventList* list, struct Event* event);
+
+/// Frees the list and every event in it.
+/// @param list Event list to be freed.
 void free_list(struct EventList* list);
 
 /// Retrieves an event in the list.
+/// @note Uses the hash index, so the cost does not depend on the number of events.
+/// Takes no lock: must be called inside an epoch read-side section (or with the list locked), and the
+/// returned event is only guaranteed to stay valid until that section ends.
 /// @param list Event list to be searched
 /// @param event_id Event id.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-struct Event* get_event(struct EventList* list, unsigned int event_id, struct ListNode* from, struct ListNode* to);
+struct Event* get_event(struct EventList* list, unsigned int event_id);
 
 #endif  // SERVER_EVENT_LIST_H
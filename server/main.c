@@ -4,6 +4,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <fcntl.h>
 #include <string.h>
 #include <pthread.h>
@@ -12,9 +14,12 @@
 #include <bits/types/sigset_t.h>
 #include <errno.h>
 
+#include "common/codec.h"
 #include "common/constants.h"
 #include "common/io.h"
+#include "common/ring.h"
 #include "operations.h"
+#include "session.h"
 
 pthread_t workerThreads[MAX_SESSION_COUNT];
 int sessionIDs[2][MAX_RESERVATION_SIZE] = {0};
@@ -24,6 +29,8 @@ typedef struct {
     int session_id;
     char req_pipe_path[256];
     char resp_pipe_path[256];
+    char shm_name[256];  // Shared memory proposed by the client for its requests and responses, empty if none
+    int socket_fd;       // Connection accepted on the session socket, -1 for a session set up through the server pipe
     pthread_t worker_thread;
 } SessionInfo;
 
@@ -39,7 +46,6 @@ int active_clients = 0;
 pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
 
-pthread_mutex_t server_mutex = PTHREAD_MUTEX_INITIALIZER;
 pthread_cond_t buffer_not_full = PTHREAD_COND_INITIALIZER;
 
 
@@ -94,20 +100,27 @@ void *worker_thread_function() {
 
   while (1){
     pthread_mutex_lock(&session_mutex);
-    pthread_cond_wait(&cond, &session_mutex);
-    pthread_mutex_unlock(&session_mutex);
-
+    while (sessionBuffer.count == 0) pthread_cond_wait(&cond, &session_mutex);
     //sessionIDs[0][thread_index] = 1;
     SessionInfo currentSession = dequeueSession(&sessionBuffer);
+    pthread_mutex_unlock(&session_mutex);
 
     //SessionInfo* session_info = (SessionInfo*)args;
     // Access members of the SessionInfo struct
     //int session_id = session_info->session_id;
     //printf("session id:%d\n", session_id);
     // Open and associate request and response pipes
-    int req_pipe_fd = open(currentSession.req_pipe_path, O_RDONLY); //| O_NONBLOCK);
-    int resp_pipe_fd = open(currentSession.resp_pipe_path, O_WRONLY);
-    printf("char pipe:%s %s\n", currentSession.req_pipe_path, currentSession.resp_pipe_path);
+    // A socket carries both ways, its first record being the setup message: the shared memory proposed, if any
+    int req_pipe_fd, resp_pipe_fd;
+    if (currentSession.socket_fd != -1) {
+      req_pipe_fd = resp_pipe_fd = currentSession.socket_fd;
+      ssize_t setup_size = read(req_pipe_fd, currentSession.shm_name, sizeof(currentSession.shm_name) - 1);
+      currentSession.shm_name[setup_size > 0 ? setup_size : 0] = '\0';
+    } else {
+      req_pipe_fd = open(currentSession.req_pipe_path, O_RDONLY); //| O_NONBLOCK);
+      resp_pipe_fd = open(currentSession.resp_pipe_path, O_WRONLY);
+      printf("char pipe:%s %s\n", currentSession.req_pipe_path, currentSession.resp_pipe_path);
+    }
     if (req_pipe_fd == -1 || resp_pipe_fd == -1) {
           perror("Error opening pipes");
           // Handle error
@@ -123,129 +136,119 @@ void *worker_thread_function() {
       perror("Error writing session_id to response pipe");
     }
 
-    while(1){ //le os pedidos do cliente 
-
-      char request_buffer[pipeBuffer];
-      memset(request_buffer, 0, sizeof(request_buffer));
-      //ssize_t bytes_read2 = read(req_pipe_fd, &request_buffer, sizeof(request_buffer));
-      read(req_pipe_fd, &request_buffer, sizeof(request_buffer));  
-      char command;
-      if (sscanf(request_buffer, " %c", &command) == 1) {
-        if (command == '2'){
-          sessionIDs[0][currentSession.session_id] = 0;
-          break;
-        }
-
-        printf("Received Command: %c\n", command);
-        // Successfully read the command
-        switch (command) {
-          case '2':
-          break;
-
-          case '3':
-            // Command 3 stands for create event
-            unsigned int create_event_id;
-            size_t create_num_rows, create_num_cols;
-            if (sscanf(request_buffer, " %c %u %zu %zu", &command, &create_event_id, &create_num_rows, &create_num_cols) == 4) {
-                // Store session information
-                printf("Received Command: %c, Event ID: %u, Num Rows: %zu, Num Cols: %zu\n",
-                        command, create_event_id, create_num_rows, create_num_cols);
-            }
-            int answerC = ems_create(create_event_id, create_num_rows, create_num_cols);
-            write(resp_pipe_fd, &answerC, sizeof(int));
-            // falta registrar o output do ems_create e enviá-lo através da resp_pipe para o cliente poder ler
-            // implementar os outros casos
-            break;
-          case '4':
-            // Command 4 stands for reserve event
-            size_t request_buffer_size = strlen(request_buffer) + 1;
-            char ReserveBuFe[pipeBuffer];
-            char auxBuf[pipeBuffer];
-            strncpy(ReserveBuFe, request_buffer, request_buffer_size);
-            printf("rbuffer: %s\n", ReserveBuFe);
-            unsigned int reserve_event_id;
-            size_t reserve_num_seats;
-            size_t *reserve_xs, *reserve_ys;
-            reserve_xs = (size_t*)malloc(MAX_RESERVATION_SIZE * sizeof(size_t));
-            reserve_ys = (size_t*)malloc(MAX_RESERVATION_SIZE * sizeof(size_t));
-            // Assuming MAX_RESERVATION_SIZE is the maximum number of elements in reserve_xs and reserve_ys
-            if (sscanf(ReserveBuFe, " %c %u %zu", &command, &reserve_event_id, &reserve_num_seats) == 3) {
-              printf("Received Command: %c, Event ID: %u, Num Seats: %zu\n",
-              command, reserve_event_id, reserve_num_seats);
-            }
-
-            sprintf(auxBuf, "%c %u %zu", command, reserve_event_id, reserve_num_seats);
-            printf("auxBuf: %ld\n", strlen(auxBuf));
-
-            int upgrade = 0;
-
-            //printf("request_buffer: %s\n", ReserveBuFe + 6 + upgrade);
-            for (size_t i = 0; i < reserve_num_seats; ++i) {
-                if (sscanf(ReserveBuFe + strlen(auxBuf) + 1 + upgrade, " %zu %zu",&reserve_xs[i], &reserve_ys[i]) != 2) {
-                    // Handle parsing error
-                    printf("Error parsing command\n");
-                    break;
-                }
-
-                char aux2Buf[pipeBuffer];
-                sprintf(aux2Buf, "%zu %zu", reserve_xs[i], reserve_ys[i]);
-                upgrade += (int) strlen(aux2Buf) + 1;
-                memset(aux2Buf, 0, strlen(aux2Buf));
-            }
-
-            for (size_t i = 0; i < reserve_num_seats; ++i) {
-              printf("xs[%zu], ys[%zu]\n", reserve_xs[i], reserve_ys[i]);
-            }
-
-            int answer = ems_reserve(reserve_event_id, reserve_num_seats, reserve_xs, reserve_ys);
-            // falta registrar o output do ems_reserve e enviá-lo através da resp_pipe para o cliente poder ler
-            // Libera a memória alocada
-            write(resp_pipe_fd, &answer, sizeof(int));
-            free(reserve_xs);
-            free(reserve_ys);
-            break;
-
-          case '5':
-            unsigned int show_event_id;
-            if (sscanf(request_buffer, " %c %u", &command, &show_event_id) == 2) {
-                // Store session information
-                printf("Received Command: %c, Event ID: %u\n", command, show_event_id);
-            }
-            ems_show(resp_pipe_fd, show_event_id);
-            // falta registrar o output do ems_show e enviá-lo através da resp_pipe para o cliente poder ler
-            // implementar os outros casos
-            break;
-
-          case '6':
-            if (sscanf(request_buffer, " %c", &command) == 1) {
-                // Store session information
-                printf("Received Command: %c\n", command);
-            }
-            ems_list_events(resp_pipe_fd);
-            // falta registrar o output do ems_list e enviá-lo através da resp_pipe para o cliente poder ler
-            // implementar os outros casos
-            break;
-
-          default:
-            break;
-        }
+    // A client proposing shared memory is told whether the server could map it, and otherwise stays on its pipes
+    int records = currentSession.socket_fd != -1;
+    struct Channel requests = {.fd = req_pipe_fd, .records = records}, responses = {.fd = resp_pipe_fd, .records = records};
+    struct ShmRegion* region = NULL;
+    if (currentSession.shm_name[0] != '\0') {
+      region = shm_region_open(currentSession.shm_name);
+      int accepted = region != NULL;
+      if (write(resp_pipe_fd, &accepted, sizeof(accepted)) != sizeof(accepted)) {
+        perror("Error writing transport to response pipe");
+      }
+      if (region != NULL) {
+        requests.ring = &region->requests;
+        responses.ring = &region->responses;
       }
     }
-    if (active_clients > MAX_SESSION_COUNT)
-      active_clients = MAX_SESSION_COUNT;
+
+    // Returns once the client is gone and every request it sent has been answered
+    serve_session(&requests, &responses);
+    if (region != NULL) shm_region_close(region);
+    close(req_pipe_fd);
+    if (resp_pipe_fd != req_pipe_fd) close(resp_pipe_fd);
+
+    pthread_mutex_lock(&session_mutex);
+    sessionIDs[0][currentSession.session_id] = 0;
     if (active_clients == (MAX_SESSION_COUNT)){
       printf("CONDICAO DO SIGNAL- cliente:%d\n", active_clients);
       pthread_cond_signal(&buffer_not_full);
     }
     active_clients = active_clients - 1;
     printf("cliente droppado:%d\n", active_clients);
+    pthread_mutex_unlock(&session_mutex);
     //pthread_exit(NULL);
   }
  }
 
+/// Hands a new session to the workers, waiting for one of the MAX_SESSION_COUNT sessions to end if all are taken.
+/// @param new_session Session, whose id is chosen here.
+void admitSession(SessionInfo new_session) {
+  pthread_mutex_lock(&session_mutex);
+  while (active_clients == (MAX_SESSION_COUNT)){
+    printf("CONDICAO DO WAIT- cliente:%d\n", active_clients);
+    pthread_cond_wait(&buffer_not_full, &session_mutex);
+  }
+  active_clients++;
+
+  for (int i = 0; i < MAX_SESSION_COUNT; ++i) {
+    if(sessionIDs[0][i] == 0){
+      new_session.session_id = i;
+      sessionIDs[0][i] = 1;
+      break;
+    }
+  }
+  printf("session ID: %d\n", new_session.session_id);
+  //TODO: Write new client to the producer-consumer buffer
+  enqueueSession(&sessionBuffer, new_session);
+  printf("cliente atual:%d\n", active_clients);
+  pthread_cond_signal(&cond);
+  pthread_mutex_unlock(&session_mutex);
+}
+
+/// Accepts connections on the session socket, each one a session, alongside the server pipe.
+/// @param arg Pointer to the listening socket.
+/// @return Never returns unless accept fails.
+void *socket_listener_function(void *arg) {
+  int listen_fd = *(int *)arg;
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  while (1) {
+    int socket_fd = accept(listen_fd, NULL, NULL);
+    if (socket_fd == -1) {
+      if (errno == EINTR || errno == ECONNABORTED) continue;
+      perror("Error accepting session");
+      return NULL;
+    }
+
+    SessionInfo new_session;
+    new_session.req_pipe_path[0] = new_session.resp_pipe_path[0] = '\0';
+    new_session.socket_fd = socket_fd;
+    admitSession(new_session);
+  }
+}
+
+/// Creates the socket sessions can be set up through instead of the server pipe.
+/// @param path Path to bind the socket to, which must not exist.
+/// @return File descriptor of the listening socket, -1 if it could not be created.
+int listen_socket(const char* path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "Socket path too long\n");
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+
+  // Seqpacket keeps each message whole, and a connection is ready to use as soon as it is accepted
+  int listen_fd = socket(AF_UNIX, SOCK_SEQPACKET, 0);
+  if (listen_fd == -1) {
+    perror("Error creating socket");
+    return -1;
+  }
+  if (bind(listen_fd, (struct sockaddr*)&address, sizeof(address)) == -1 || listen(listen_fd, SOMAXCONN) == -1) {
+    perror("Error binding socket");
+    close(listen_fd);
+    return -1;
+  }
+  return listen_fd;
+}
+
 int main(int argc, char* argv[]) {
-  if (argc < 2 || argc > 3) {
-    fprintf(stderr, "Usage: %s\n <pipe_path> [delay]\n", argv[0]);
+  if (argc < 2 || argc > 7) {
+    fprintf(stderr, "Usage: %s\n <pipe_path> [delay] [shards] [locked|lockfree] [cache] [socket_path]\n", argv[0]);
     return 1;
   }
   // Create the named pipe
@@ -255,7 +258,7 @@ int main(int argc, char* argv[]) {
   }
   char* endptr;
   unsigned int state_access_delay_us = STATE_ACCESS_DELAY_US;
-  if (argc == 3) {
+  if (argc >= 3) {
     unsigned long int delay = strtoul(argv[2], &endptr, 10);
 
     if (*endptr != '\0' || delay > UINT_MAX) {
@@ -266,11 +269,51 @@ int main(int argc, char* argv[]) {
     state_access_delay_us = (unsigned int)delay;
   }
 
-  if (ems_init(state_access_delay_us)) {
+  size_t shard_count = EVENT_SHARD_COUNT;
+  if (argc >= 4) {
+    unsigned long int shards = strtoul(argv[3], &endptr, 10);
+
+    if (*endptr != '\0' || shards == 0) {
+      fprintf(stderr, "Invalid shard count\n");
+      return 1;
+    }
+
+    shard_count = (size_t)shards;
+  }
+
+  enum ReserveEngine engine = RESERVE_LOCKED;
+  if (argc >= 5) {
+    if (strcmp(argv[4], "lockfree") == 0) {
+      engine = RESERVE_LOCK_FREE;
+    } else if (strcmp(argv[4], "locked") != 0) {
+      fprintf(stderr, "Invalid reservation engine\n");
+      return 1;
+    }
+  }
+
+  size_t cache_capacity = EVENT_CACHE_CAPACITY;
+  if (argc >= 6) {
+    unsigned long int capacity = strtoul(argv[5], &endptr, 10);
+
+    if (*endptr != '\0') {
+      fprintf(stderr, "Invalid event cache capacity\n");
+      return 1;
+    }
+
+    cache_capacity = (size_t)capacity;
+  }
+
+  if (ems_init(state_access_delay_us, shard_count, engine, cache_capacity)) {
     fprintf(stderr, "Failed to initialize EMS\n");
     return 1;
   }
 
+  if (executors_start(REQUEST_EXECUTOR_COUNT)) {
+    fprintf(stderr, "Failed to start request executors\n");
+    ems_terminate();
+    return 1;
+  }
+
   // Open the named pipe for reading
   int pipe_fd = open(argv[1], O_RDWR);
   if (pipe_fd == -1) {
@@ -291,6 +334,18 @@ int main(int argc, char* argv[]) {
     pthread_create(&workerThreads[i], NULL, worker_thread_function, &sessionIDs[1][i]);
   }
 
+  // Sessions may also be set up through a socket, each connection carrying its own requests and responses
+  int listen_fd = -1;
+  pthread_t socket_listener;
+  if (argc == 7) {
+    listen_fd = listen_socket(argv[6]);
+    if (listen_fd == -1 || pthread_create(&socket_listener, NULL, socket_listener_function, &listen_fd) != 0) {
+      fprintf(stderr, "Failed to listen on session socket\n");
+      ems_terminate();
+      return 1;
+    }
+  }
+
   while (1) {
     //TODO: Read from pipe
       char buffer[pipeBuffer];
@@ -318,14 +373,6 @@ int main(int argc, char* argv[]) {
         //} 
       }
       printf("pre wait do server\n");
-      if (active_clients == (MAX_SESSION_COUNT)){
-        printf("CONDICAO DO WAIT- cliente:%d\n", active_clients);
-        pthread_mutex_lock(&server_mutex);
-        pthread_cond_wait(&buffer_not_full, &server_mutex);
-        pthread_mutex_unlock(&server_mutex);
-      }
-
-      pthread_mutex_lock(&session_mutex);
 
       //if(print_info_flag == 1){
       //  printf("entrou no if print\n");
@@ -334,28 +381,14 @@ int main(int argc, char* argv[]) {
       //}
 
       SessionInfo new_session;
-      if (active_clients > MAX_SESSION_COUNT)
-        active_clients = MAX_SESSION_COUNT;
-      active_clients++;
-
-      if (sscanf(buffer, "%s %s", new_session.req_pipe_path, new_session.resp_pipe_path) == 2){
+      new_session.shm_name[0] = '\0';
+      new_session.socket_fd = -1;
+      if (sscanf(buffer, "%s %s %s", new_session.req_pipe_path, new_session.resp_pipe_path, new_session.shm_name) >= 2){
         // Store session information
         printf("information received: %s %s\n", new_session.req_pipe_path, new_session.resp_pipe_path);
       }
 
-      for (int i = 0; i < MAX_SESSION_COUNT; ++i) {
-        if(sessionIDs[0][i] == 0){
-          new_session.session_id = i;
-          sessionIDs[0][i] = 1;
-          break;
-        }
-      }
-      printf("session ID: %d\n", new_session.session_id);
-      //TODO: Write new client to the producer-consumer buffer
-      enqueueSession(&sessionBuffer, new_session);
-      printf("cliente atual:%d\n", active_clients);
-      pthread_cond_signal(&cond);
-      pthread_mutex_unlock(&session_mutex);
+      admitSession(new_session);
 
       memset(buffer, 0, sizeof(buffer));
                                                                                                                                                                                                                                  
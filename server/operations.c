@@ -1,387 +1,2210 @@
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "common/codec.h"
 #include "common/io.h"
+#include "epoch.h"
+#include "eventcache.h"
 #include "eventlist.h"
+#include "operations.h"
+#include "timerwheel.h"
 #include "common/constants.h"
 
-static struct EventList* event_list = NULL;
+#define BEST_SEATS_ATTEMPTS 8  // Searches for the best seats before giving up on a contended event
+#define HOLD_TICK_MS 10        // Resolution of hold expiry
+#define SHOW_SNAPSHOT_ATTEMPTS 8  // Optimistic snapshots of an event before holding its writers off instead
+#define CLAIMED_SEAT UINT_MAX     // Seat claimed by a lock-free reservation that has no id yet (never a real id)
+
+#define SEAT_SEQ_WRITERS 0xffffffffu           // Bits of Event::seat_seq counting writers in progress
+#define SEAT_SEQ_VERSION ((uint64_t)1 << 32)  // Increment of Event::seat_seq for each finished write
+
+// Seats held for a limited time, released unless confirmed before the timer fires
+struct Hold {
+  struct TimerEntry timer;      // Expiry of the hold (first member, so the timer leads back to its hold)
+  unsigned int event_id;        // Event the held seats belong to
+  unsigned int reservation_id;  // Reservation holding the seats, 0 until it is recorded
+  unsigned int ttl_ms;          // Time the seats are held for
+};
+
+static struct EventList** event_shards = NULL;  // Registry of events, split in shards by event id
+static enum ReserveEngine reserve_engine = RESERVE_LOCKED;
+static size_t num_shards = 0;
+static atomic_ulong next_event_seq = 0;  // Creation order of the next event
+static struct ThreadSlab seat_lists;     // Memory of the seat lists of the reservations
+
+// Reports being taken, each reading the seats as of its version
+struct ReportReader {
+  unsigned long version;
+  struct ReportReader* next;
+};
+
+static atomic_ulong report_clock = 1;    // Versions of reports and of the writes logged for them (0 is none)
+static atomic_uint active_reports = 0;  // Reports registered, while writers must log what they overwrite
+static struct ReportReader* report_readers = NULL;
+static pthread_mutex_t report_mutex = PTHREAD_MUTEX_INITIALIZER;  // Protects report_readers and trimming
 static unsigned int state_access_delay_us = 0;
 
-/// Gets the event with the given ID from the state.
-/// @note Will wait to simulate a real system accessing a costly memory resource.
+/// Gets the shard of the registry responsible for the given event.
+/// @param event_id The ID of the event.
+/// @return The shard where the event is (or would be) stored.
+static struct EventList* shard_of(unsigned int event_id) { return event_shards[event_id % num_shards]; }
+
+// Access to an event in the costly state, issued ahead of the moment its result is needed so several
+// accesses can be outstanding at once
+struct StateFetch {
+  unsigned int event_id;
+  struct timespec ready;  // Moment the state answers (CLOCK_MONOTONIC)
+};
+
+/// Issues an access to the state for the given event, without waiting for it.
+/// @param fetch Access to be issued.
+/// @param event_id The ID of the event to get.
+static void issue_fetch(struct StateFetch* fetch, unsigned int event_id) {
+  fetch->event_id = event_id;
+  clock_gettime(CLOCK_MONOTONIC, &fetch->ready);
+  fetch->ready.tv_sec += (time_t)(state_access_delay_us / 1000000);
+  fetch->ready.tv_nsec += (long)(state_access_delay_us % 1000000) * 1000;
+  if (fetch->ready.tv_nsec >= 1000000000) {
+    fetch->ready.tv_sec++;
+    fetch->ready.tv_nsec -= 1000000000;
+  }
+}
+
+// Reservation waiting in its event's queue until a combiner applies it, kept on the requester's stack
+struct ReserveRequest {
+  size_t num_seats;
+  size_t* xs;
+  size_t* ys;
+  struct SeatList* seats;       // Seat list recorded on success
+  unsigned int reservation_id;  // Id of the reservation, set on success
+  int result;                   // 0 if the reservation was created, 1 otherwise
+  sem_t wakeup;                 // Posted once the request is applied
+  struct ReserveRequest* next;  // Request queued before this one
+};
+
+// Accesses handed over by ems_complete_fetches, in issue order, until the calling thread takes them
+static _Thread_local struct StateFetch prefetched[MAX_BATCH_OPERATIONS];
+static _Thread_local size_t num_prefetched = 0;
+
+/// Starts an access to the state for the given event, taking the first one the calling thread prefetched for it
+/// if any, and issuing it otherwise.
+/// @param fetch Access to be started.
+/// @param event_id The ID of the event to get.
+static void start_fetch(struct StateFetch* fetch, unsigned int event_id) {
+  for (size_t i = 0; i < num_prefetched; i++) {
+    if (prefetched[i].event_id == event_id) {
+      *fetch = prefetched[i];
+      memmove(&prefetched[i], &prefetched[i + 1], (num_prefetched - i - 1) * sizeof(struct StateFetch));
+      num_prefetched--;
+      return;
+    }
+  }
+  issue_fetch(fetch, event_id);
+}
+
+/// Waits for an access to the state to answer.
+/// @note Events found in the event cache are not waited for. Otherwise, will wait to simulate a real system
+/// accessing a costly memory resource. Must be called outside of any epoch, so the wait does not hold back
+/// the reclamation of retired memory, and with no lock held.
+/// @param fetch Access issued with issue_fetch or start_fetch.
+static void await_fetch(struct StateFetch* fetch) {
+  epoch_enter();
+  bool cached = event_cache_contains(fetch->event_id);
+  epoch_exit();
+  if (cached) return;
+
+  // Should not be removed
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &fetch->ready, NULL) == EINTR)
+    ;
+}
+
+/// Gets the event an access to the state answered with, and caches it.
+/// @note Must be called inside an epoch, after the access was waited for with await_fetch.
+/// @param fetch Access waited for.
+/// @return Pointer to the event if found, NULL otherwise.
+static struct Event* resolve_fetch(struct StateFetch* fetch) {
+  struct Event* event = event_cache_get(fetch->event_id);
+  if (event != NULL) return event;
+
+  event = get_event(shard_of(fetch->event_id), fetch->event_id);
+  if (event != NULL) event_cache_put(event);
+  return event;
+}
+
+/// Gets the event with the given ID from the state, then enters an epoch for the caller to use it in.
+/// @note Waits for the access like await_fetch before entering the epoch, so must be called outside of any
+/// epoch and with no lock held. The caller leaves the epoch with epoch_exit, whether the event was found or not.
 /// @param event_id The ID of the event to get.
-/// @param from First node to be searched.
-/// @param to Last node to be searched.
 /// @return Pointer to the event if found, NULL otherwise.
-static struct Event* get_event_with_delay(unsigned int event_id, struct ListNode* from, struct ListNode* to) {
-  struct timespec delay = {0, state_access_delay_us * 1000};
-  nanosleep(&delay, NULL);  // Should not be removed
+static struct Event* enter_event(unsigned int event_id) {
+  struct StateFetch fetch;
+  start_fetch(&fetch, event_id);
+  await_fetch(&fetch);
+  epoch_enter();
+  return resolve_fetch(&fetch);
+}
+
+/// Gets the index of a seat.
+/// @note This function assumes that the seat exists.
+/// @param event Event to get the seat index from.
+/// @param row Row of the seat.
+/// @param col Column of the seat.
+/// @return Index of the seat.
+static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+
+/// Gets the word of the occupancy bitmap holding a seat.
+/// @note This function assumes that the seat exists.
+/// @param event Event to get the word from.
+/// @param row Row of the seat.
+/// @param col Column of the seat.
+/// @return Pointer to the word holding the seat's bit.
+static _Atomic uint64_t* seat_word(struct Event* event, size_t row, size_t col) {
+  return &event->occupied[(row - 1) * event->row_words + (col - 1) / 64];
+}
+
+/// Gets the mask of a seat's bit inside its bitmap word.
+/// @param col Column of the seat.
+/// @return Mask with only the seat's bit set.
+static uint64_t seat_mask(size_t col) { return (uint64_t)1 << ((col - 1) % 64); }
+
+/// Gets the largest reservation id that fits in a seat of the given width.
+/// @param width Bytes per seat.
+/// @return Largest id a seat can hold.
+static unsigned int max_seat_value(unsigned int width) {
+  return width == 1 ? UINT8_MAX : width == 2 ? UINT16_MAX : UINT_MAX;
+}
+
+/// Reads a seat of a seat array.
+/// @param data Seat array.
+/// @param width Bytes per seat.
+/// @param index Index of the seat.
+/// @return Id of the reservation holding the seat, 0 if the seat is free.
+static unsigned int load_seat(void* data, unsigned int width, size_t index) {
+  switch (width) {
+    case 1:
+      return atomic_load_explicit(&((_Atomic uint8_t*)data)[index], memory_order_relaxed);
+    case 2:
+      return atomic_load_explicit(&((_Atomic uint16_t*)data)[index], memory_order_relaxed);
+    default:
+      return atomic_load_explicit(&((atomic_uint*)data)[index], memory_order_relaxed);
+  }
+}
+
+/// Writes a seat of a seat array.
+/// @param data Seat array.
+/// @param width Bytes per seat.
+/// @param index Index of the seat.
+/// @param value Id of the reservation holding the seat (must fit in the width).
+static void store_seat(void* data, unsigned int width, size_t index, unsigned int value) {
+  switch (width) {
+    case 1:
+      atomic_store_explicit(&((_Atomic uint8_t*)data)[index], (uint8_t)value, memory_order_relaxed);
+      break;
+    case 2:
+      atomic_store_explicit(&((_Atomic uint16_t*)data)[index], (uint16_t)value, memory_order_relaxed);
+      break;
+    default:
+      atomic_store_explicit(&((atomic_uint*)data)[index], value, memory_order_relaxed);
+      break;
+  }
+}
+
+/// Starts writing seats of an event. Snapshots overlapping the write are retried.
+/// @note Writers do not exclude each other here: the stripes (or the seats' compare-and-swap) still do that.
+/// @param event Event whose seats are written.
+static void begin_seat_write(struct Event* event) {
+  for (;;) {
+    // A snapshot that gave up on retrying holds new writes off until it has copied the seats
+    while (atomic_load(&event->snapshot_waiters) != 0) sched_yield();
+
+    // Sequentially consistent, so a report registered after this sees the write in progress (see write_version),
+    // and either a snapshot closing the gate sees the write or the write sees the gate
+    atomic_fetch_add(&event->seat_seq, 1);
+    if (atomic_load(&event->snapshot_waiters) == 0) break;
+    atomic_fetch_sub(&event->seat_seq, 1);
+  }
+  atomic_thread_fence(memory_order_release);
+}
+
+/// Finishes writing seats of an event.
+/// @param event Event whose seats were written.
+static void end_seat_write(struct Event* event) {
+  atomic_fetch_add_explicit(&event->seat_seq, SEAT_SEQ_VERSION - 1, memory_order_release);
+}
+
+/// Gets the version of a write, for the undo records of the seats it overwrites.
+/// @note Must be called once the write sections of every event written are open. A report registered after
+/// that point gets a lower version, and one registered before it is seen here, so a write left unlogged is
+/// always part of every report's view.
+/// @return Version of the write, 0 if no report is being taken (and the write need not be logged).
+static unsigned long write_version(void) {
+  if (atomic_load(&active_reports) == 0) return 0;
+  return atomic_load(&report_clock);
+}
+
+/// Allocates the undo record of a write.
+/// @param event Event whose seats are written.
+/// @param version Version of the write.
+/// @param num_seats Number of seats written.
+/// @return Newly allocated record, to be filled in and pushed with push_undo. NULL if the write needs no record
+/// (version 0) or on failure.
+static struct SeatUndo* create_undo(struct Event* event, unsigned long version, size_t num_seats) {
+  if (version == 0) return NULL;
+
+  struct SeatUndo* undo =
+      arena_alloc(&shard_of(event->id)->seat_arena, sizeof(struct SeatUndo) + num_seats * sizeof(struct SeatValue));
+  if (undo == NULL) {
+    fprintf(stderr, "Error allocating memory for seat history\n");
+    return NULL;
+  }
+  undo->version = version;
+  undo->num_seats = num_seats;
+  return undo;
+}
+
+/// Publishes the undo record of a write, before its write section closes.
+/// @param event Event whose seats were written.
+/// @param undo Record to publish (may be NULL).
+static void push_undo(struct Event* event, struct SeatUndo* undo) {
+  if (undo == NULL) return;
+
+  struct SeatUndo* head = atomic_load_explicit(&event->undo, memory_order_relaxed);
+  do {
+    atomic_store_explicit(&undo->next, head, memory_order_relaxed);
+  } while (!atomic_compare_exchange_weak_explicit(&event->undo, &head, undo, memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+/// Gets the stripe covering a row.
+/// @param event Event to get the stripe from.
+/// @param row Row of the seat.
+/// @return Index of the stripe.
+static size_t stripe_of(struct Event* event, size_t row) { return (row - 1) / event->rows_per_stripe; }
+
+/// Gets the mask with every stripe of an event.
+static uint64_t all_stripes(struct Event* event) {
+  return event->num_stripes == 64 ? ~(uint64_t)0 : ((uint64_t)1 << event->num_stripes) - 1;
+}
+
+/// Unlocks the given stripes of an event.
+/// @param event Event whose stripes are unlocked.
+/// @param stripes Mask of the stripes to unlock.
+static void unlock_stripes(struct Event* event, uint64_t stripes) {
+  for (size_t i = 0; stripes != 0; i++, stripes >>= 1) {
+    if (stripes & 1) pthread_mutex_unlock(&event->stripes[i]);
+  }
+}
+
+/// Locks the given stripes of an event.
+/// @note Stripes are always locked in ascending order, so reservations spanning several stripes cannot deadlock.
+/// @param event Event whose stripes are locked.
+/// @param stripes Mask of the stripes to lock.
+/// @return 0 if every stripe was locked, 1 otherwise (in which case none is held).
+static int lock_stripes(struct Event* event, uint64_t stripes) {
+  uint64_t locked = 0;
+  for (size_t i = 0; i < event->num_stripes; i++) {
+    uint64_t bit = (uint64_t)1 << i;
+    if (!(stripes & bit)) continue;
+
+    if (pthread_mutex_lock(&event->stripes[i]) != 0) {
+      fprintf(stderr, "Error locking mutex\n");
+      unlock_stripes(event, locked);
+      return 1;
+    }
+    locked |= bit;
+  }
+  return 0;
+}
+
+/// Initializes the locks of a new event: its lock stripes, splitting its rows evenly.
+/// @param shard Shard the event belongs to, whose arena the stripes are allocated from.
+/// @param event Event with its rows already set.
+/// @return 0 if the locks were initialized successfully, 1 otherwise (in which case stripes is NULL).
+static int init_locks(struct EventList* shard, struct Event* event) {
+  size_t rows = event->rows > 0 ? event->rows : 1;
+  event->num_stripes = rows < MAX_SEAT_STRIPES ? rows : MAX_SEAT_STRIPES;
+  event->rows_per_stripe = (rows + event->num_stripes - 1) / event->num_stripes;
+  event->num_stripes = (rows + event->rows_per_stripe - 1) / event->rows_per_stripe;
+
+  event->stripes = arena_alloc(&shard->seat_arena, event->num_stripes * sizeof(pthread_mutex_t));
+  if (event->stripes == NULL) return 1;
+
+  size_t initialized = 0;
+  while (initialized < event->num_stripes && pthread_mutex_init(&event->stripes[initialized], NULL) == 0) {
+    initialized++;
+  }
+  if (initialized == event->num_stripes) return 0;
+
+  while (initialized-- > 0) pthread_mutex_destroy(&event->stripes[initialized]);
+  arena_free(event->stripes);
+  event->stripes = NULL;
+  event->num_stripes = 0;
+  return 1;
+}
+
+/// Gets the number of free seats of an event.
+/// @note The count follows the bitmap, so it is exact with every stripe of the event locked.
+/// @param event Event to count the free seats of.
+/// @return Number of seats without a reservation.
+static size_t free_seats(struct Event* event) {
+  return atomic_load_explicit(&event->free_count, memory_order_relaxed);
+}
+
+/// Gets the number of free seats of a row.
+/// @note The count follows the bitmap, so it is exact with the row's stripe locked.
+/// @param event Event the row belongs to.
+/// @param row Row to count the free seats of.
+/// @return Number of seats of the row without a reservation.
+static size_t row_free_seats(struct Event* event, size_t row) {
+  return atomic_load_explicit(&event->row_free[row - 1], memory_order_relaxed);
+}
+
+/// Counts seats as taken in the free seat counters of their event, once their bits are set.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats.
+/// @param xs Array of rows of the seats.
+static void count_taken(struct Event* event, size_t num_seats, size_t* xs) {
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_sub_explicit(&event->row_free[xs[i] - 1], 1, memory_order_relaxed);
+  }
+  atomic_fetch_sub_explicit(&event->free_count, num_seats, memory_order_relaxed);
+}
+
+/// Counts seats as free again in the free seat counters of their event, once their bits are cleared.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats.
+/// @param xs Array of rows of the seats.
+static void count_freed(struct Event* event, size_t num_seats, size_t* xs) {
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_add_explicit(&event->row_free[xs[i] - 1], 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&event->free_count, num_seats, memory_order_relaxed);
+}
+
+/// Gets the word of a row's bitmap with the taken seats, counting the padding past the last column as taken.
+/// @param event Event the row belongs to.
+/// @param row Row of the word.
+/// @param w Index of the word within the row.
+/// @return Bits of the taken seats.
+static uint64_t taken_seats(struct Event* event, size_t row, size_t w) {
+  uint64_t taken = atomic_load_explicit(&event->occupied[(row - 1) * event->row_words + w], memory_order_relaxed);
+  size_t remaining = event->cols - w * 64;
+  if (remaining < 64) taken |= ~(uint64_t)0 << remaining;
+  return taken;
+}
+
+static int compare_event_seq(const void* a, const void* b) {
+  unsigned long seq_a = (*(struct Event* const*)a)->seq;
+  unsigned long seq_b = (*(struct Event* const*)b)->seq;
+  return (seq_a > seq_b) - (seq_a < seq_b);
+}
+
+/// Collects every event of the registry, in creation order.
+/// @note All shards are read-locked together, so the result is a consistent view of the registry.
+/// Must be called inside an epoch read-side section, which keeps the collected events valid.
+/// @param events Pointer to store the newly allocated array of events in. Must be freed by the caller.
+/// @param num_events Pointer to store the number of events in.
+/// @param version Pointer to store a new report version in, taken while the registry is locked (may be NULL).
+/// @return 0 if the events were collected successfully, 1 otherwise.
+static int collect_events(struct Event*** events, size_t* num_events, unsigned long* version) {
+  size_t locked = 0;
+  for (; locked < num_shards; locked++) {
+    if (pthread_rwlock_rdlock(&event_shards[locked]->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
+      break;
+    }
+  }
+
+  size_t count = 0;
+  for (size_t i = 0; i < locked; i++) {
+    count += event_shards[i]->size;
+  }
+  if (version != NULL) *version = atomic_fetch_add(&report_clock, 1);
+
+  struct Event** collected = NULL;
+  if (locked == num_shards && count > 0) {
+    collected = malloc(count * sizeof(struct Event*));
+    if (collected == NULL) {
+      fprintf(stderr, "Error allocating memory for event list\n");
+    } else {
+      size_t n = 0;
+      for (size_t i = 0; i < num_shards; i++) {
+        for (struct ListNode* current = event_shards[i]->head; current != NULL; current = current->next) {
+          collected[n++] = current->event;
+        }
+      }
+    }
+  }
+
+  // A shard left unlocked was not counted, so the registry may hold events even when none were collected
+  bool complete = locked == num_shards;
+  while (locked > 0) {
+    pthread_rwlock_unlock(&event_shards[--locked]->rwl);
+  }
+
+  if (!complete || (count > 0 && collected == NULL)) return 1;
+
+  qsort(collected, count, sizeof(struct Event*), compare_event_seq);
+  *events = collected;
+  *num_events = count;
+  return 0;
+}
+
+int ems_init(unsigned int delay_us, size_t shard_count, enum ReserveEngine engine, size_t cache_capacity) {
+  if (event_shards != NULL) {
+    fprintf(stderr, "EMS state has already been initialized\n");
+    return 1;
+  }
+
+  if (shard_count == 0) {
+    fprintf(stderr, "EMS needs at least one shard\n");
+    return 1;
+  }
+
+  event_shards = calloc(shard_count, sizeof(struct EventList*));
+  if (event_shards == NULL) return 1;
+
+  for (num_shards = 0; num_shards < shard_count; num_shards++) {
+    event_shards[num_shards] = create_list();
+    if (event_shards[num_shards] == NULL) {
+      while (num_shards > 0) free_list(event_shards[--num_shards]);
+      free(event_shards);
+      event_shards = NULL;
+      return 1;
+    }
+  }
+
+  if (thread_slab_init(&seat_lists) != 0) {
+    while (num_shards > 0) free_list(event_shards[--num_shards]);
+    free(event_shards);
+    event_shards = NULL;
+    return 1;
+  }
+
+  if (event_cache_init(cache_capacity) != 0) {
+    thread_slab_destroy(&seat_lists);
+    while (num_shards > 0) free_list(event_shards[--num_shards]);
+    free(event_shards);
+    event_shards = NULL;
+    return 1;
+  }
+
+  if (timer_wheel_start(HOLD_TICK_MS) != 0) {
+    fprintf(stderr, "Error starting hold timers\n");
+    event_cache_destroy();
+    thread_slab_destroy(&seat_lists);
+    while (num_shards > 0) free_list(event_shards[--num_shards]);
+    free(event_shards);
+    event_shards = NULL;
+    return 1;
+  }
+
+  state_access_delay_us = delay_us;
+  reserve_engine = engine;
+  return 0;
+}
+
+/// Frees a hold whose timer was still pending when the server stopped.
+static void discard_hold(struct TimerEntry* timer) { free((struct Hold*)timer); }
+
+int ems_terminate() {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < num_shards; i++) {
+    if (pthread_rwlock_wrlock(&event_shards[i]->rwl) != 0) {
+      fprintf(stderr, "Error locking list rwl\n");
+      return 1;
+    }
+  }
+
+  // Expiring holds reach into the events, so the wheel stops before they go
+  timer_wheel_stop(discard_hold);
+  event_cache_destroy();
+
+  // Retired nodes give their memory back to the shards' allocators, so they must go before the shards do
+  epoch_drain();
+  for (size_t i = 0; i < num_shards; i++) {
+    free_list(event_shards[i]);
+  }
+  thread_slab_destroy(&seat_lists);
+
+  free(event_shards);
+  event_shards = NULL;
+  num_shards = 0;
+  return 0;
+}
+
+/// Checks whether the arrays of an event of the given size fit in the address space, at the widest seat width
+/// the event may be widened to.
+/// @param num_rows Number of rows of the event.
+/// @param num_cols Number of columns of the event.
+/// @return true if the size of any of the arrays overflows, false otherwise.
+static bool event_size_overflows(size_t num_rows, size_t num_cols) {
+  size_t seats, bytes;
+  return __builtin_mul_overflow(num_rows, num_cols, &seats) ||
+         __builtin_mul_overflow(seats, sizeof(unsigned int), &bytes) ||
+         __builtin_mul_overflow(num_rows, (num_cols + 63) / 64 * sizeof(_Atomic uint64_t), &bytes) ||
+         __builtin_mul_overflow(num_rows, sizeof(atomic_size_t), &bytes);
+}
+
+int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // The sizes come from the client, so a product that wraps around must not turn into a small allocation
+  if (event_size_overflows(num_rows, num_cols)) {
+    fprintf(stderr, "Invalid event size\n");
+    return 1;
+  }
+
+  // The state is accessed before the shard is locked, so its other writers do not wait on the access
+  bool exists = enter_event(event_id) != NULL;
+  epoch_exit();
+  if (exists) {
+    fprintf(stderr, "Event already exists\n");
+    return 1;
+  }
+
+  struct EventList* shard = shard_of(event_id);
+  if (pthread_rwlock_wrlock(&shard->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  // Another session may have created the event while the state was accessed
+  if (get_event(shard, event_id) != NULL) {
+    fprintf(stderr, "Event already exists\n");
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+
+  struct Event* event = alloc_event(shard);
+
+  if (event == NULL) {
+    fprintf(stderr, "Error allocating memory for event\n");
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+
+  event->id = event_id;
+  event->rows = num_rows;
+  event->cols = num_cols;
+  atomic_init(&event->reservations, 0);
+  atomic_init(&event->seat_seq, 0);
+  atomic_init(&event->snapshot_waiters, 0);
+  atomic_init(&event->undo, NULL);
+  atomic_init(&event->reserve_queue, NULL);
+  atomic_init(&event->combining, false);
+  atomic_init(&event->deleted, false);
+  event->seq = atomic_fetch_add(&next_event_seq, 1);
+  event->data = NULL;
+  event->occupied = NULL;
+  event->row_free = NULL;
+  for (size_t segment = 0; segment < RESERVATION_SEGMENTS; segment++) {
+    atomic_init(&event->reservation_segments[segment], NULL);
+  }
+  if (init_locks(shard, event) != 0) {
+    fprintf(stderr, "Error initializing event locks\n");
+    free_event(shard, event);
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+  // Arena blocks come zeroed, so every seat starts free. Seats start one byte wide and are widened as
+  // reservation ids grow, except for the lock-free engine, which claims seats in place and so cannot move them.
+  atomic_init(&event->seat_width, reserve_engine == RESERVE_LOCK_FREE ? sizeof(atomic_uint) : 1);
+  event->data = arena_alloc(&shard->seat_arena, num_rows * num_cols * atomic_load(&event->seat_width));
+  event->row_words = (num_cols + 63) / 64;
+  event->occupied = arena_alloc(&shard->seat_arena, num_rows * event->row_words * sizeof(_Atomic uint64_t));
+  event->row_free = arena_alloc(&shard->seat_arena, num_rows * sizeof(atomic_size_t));
+  // The first segment of the reservation index comes with the event, so its first reservations need no allocation
+  atomic_init(&event->reservation_segments[0],
+              arena_alloc(&shard->seat_arena, RESERVATION_SEGMENT_SIZE * sizeof(_Atomic(struct SeatList*))));
+
+  if (event->data == NULL || event->occupied == NULL || event->row_free == NULL ||
+      atomic_load(&event->reservation_segments[0]) == NULL) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    free_event(shard, event);
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+  for (size_t row = 0; row < num_rows; row++) {
+    atomic_init(&event->row_free[row], num_cols);
+  }
+  atomic_init(&event->free_count, num_rows * num_cols);
+
+  if (append_to_list(shard, event) != 0) {
+    fprintf(stderr, "Error appending event to list\n");
+    free_event(shard, event);
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+
+  pthread_rwlock_unlock(&shard->rwl);
+  printf("fiz o create\n");
+  return 0;
+}
+
+int ems_delete(unsigned int event_id) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  // The state is accessed before the shard is locked, so its other writers do not wait on the access
+  bool found = enter_event(event_id) != NULL;
+  epoch_exit();
+  if (!found) {
+    fprintf(stderr, "Event not found\n");
+    return 1;
+  }
+
+  struct EventList* shard = shard_of(event_id);
+  if (pthread_rwlock_wrlock(&shard->rwl) != 0) {
+    fprintf(stderr, "Error locking list rwl\n");
+    return 1;
+  }
+
+  // Another session may have deleted the event while the state was accessed
+  struct Event* event = get_event(shard, event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+
+  // The cache must let go of the event before it is retired, and must not take it back in between
+  atomic_store(&event->deleted, true);
+  event_cache_remove(event);
+
+  // The event and its seat arrays are retired: given back right away if no session is reading, and otherwise
+  // by the last session that could still be reading them, as it leaves its epoch
+  if (remove_from_list(shard, event_id) != 0) {
+    fprintf(stderr, "Error removing event from list\n");
+    pthread_rwlock_unlock(&shard->rwl);
+    return 1;
+  }
+
+  pthread_rwlock_unlock(&shard->rwl);
+  return 0;
+}
+
+/// Moves the seats of an event to a wider array.
+/// @note Must be called with every stripe of the event locked, inside an epoch. Only reserved seats are
+/// copied, so the untouched pages of a large, lazily-populated seat map stay unpopulated.
+/// @param event Event whose seats are widened.
+/// @param width New number of bytes per seat.
+/// @return 0 if the seats were widened successfully, 1 otherwise.
+static int widen_seats(struct Event* event, unsigned int width) {
+  void* data = arena_alloc(&shard_of(event->id)->seat_arena, event->rows * event->cols * width);
+  if (data == NULL) {
+    fprintf(stderr, "Error allocating memory for event data\n");
+    return 1;
+  }
+
+  begin_seat_write(event);
+  void* old_data = event->data;
+  unsigned int old_width = atomic_load_explicit(&event->seat_width, memory_order_relaxed);
+  for (size_t row = 0; row < event->rows; row++) {
+    for (size_t word = 0; word < event->row_words; word++) {
+      uint64_t bits = atomic_load_explicit(&event->occupied[row * event->row_words + word], memory_order_relaxed);
+      for (; bits != 0; bits &= bits - 1) {
+        size_t index = row * event->cols + word * 64 + (size_t)__builtin_ctzll(bits);
+        store_seat(data, width, index, load_seat(old_data, old_width, index));
+      }
+    }
+  }
+
+  // Readers inside an epoch may still hold the old array. The width is published after the array, so a
+  // snapshot never reads an array with a stride wider than its seats.
+  epoch_retire(old_data, arena_free);
+  event->data = data;
+  atomic_store_explicit(&event->seat_width, width, memory_order_release);
+  end_seat_write(event);
+  return 0;
+}
+
+/// Checks whether a seat of a reservation request also appears earlier in the request.
+/// @param xs Array of rows of the requested seats.
+/// @param ys Array of columns of the requested seats.
+/// @param i Index of the seat in the request.
+/// @return 1 if the seat is repeated, 0 otherwise.
+static int seat_repeated(size_t* xs, size_t* ys, size_t i) {
+  for (size_t j = 0; j < i; j++) {
+    if (xs[j] == xs[i] && ys[j] == ys[i]) return 1;
+  }
+  return 0;
+}
+
+/// Builds the seat list of a reservation request, to be recorded in the event's reservation index.
+/// @note The list comes from the calling thread's cache, so building it takes no lock.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats (already checked to be within bounds).
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @return Newly allocated list (to be freed with thread_slab_free), NULL on failure.
+static struct SeatList* create_seat_list(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  struct SeatList* seats = thread_slab_alloc(&seat_lists, sizeof(struct SeatList) + num_seats * sizeof(size_t));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for reservation\n");
+    return NULL;
+  }
+
+  atomic_init(&seats->hold, NULL);
+  seats->num_seats = num_seats;
+  for (size_t i = 0; i < num_seats; i++) {
+    seats->seats[i] = seat_index(event, xs[i], ys[i]);
+  }
+  return seats;
+}
+
+/// Gets the entry of a reservation in its event's reservation index.
+/// @note Segment k holds the RESERVATION_SEGMENT_SIZE << k ids after those of the segments before it. A missing
+/// segment is allocated and installed with a compare-and-swap; a thread losing the race frees its copy.
+/// @param event Event the reservation belongs to.
+/// @param reservation_id Id of the reservation.
+/// @param create Whether to install the entry's segment if it is missing.
+/// @return Entry of the reservation, NULL if its segment is missing (and could not be installed, if create is set).
+static _Atomic(struct SeatList*)* reservation_entry(struct Event* event, unsigned int reservation_id, bool create) {
+  size_t block = reservation_id / RESERVATION_SEGMENT_SIZE + 1;
+  size_t segment = (size_t)(63 - __builtin_clzll(block));
+  size_t offset = reservation_id - RESERVATION_SEGMENT_SIZE * (((size_t)1 << segment) - 1);
+
+  _Atomic(struct SeatList*)* entries =
+      atomic_load_explicit(&event->reservation_segments[segment], memory_order_acquire);
+  if (entries == NULL && create) {
+    _Atomic(struct SeatList*)* fresh = arena_alloc(
+        &shard_of(event->id)->seat_arena, ((size_t)RESERVATION_SEGMENT_SIZE << segment) * sizeof(_Atomic(struct SeatList*)));
+    if (fresh == NULL) {
+      fprintf(stderr, "Error allocating memory for reservation index\n");
+      return NULL;
+    }
+    if (atomic_compare_exchange_strong_explicit(&event->reservation_segments[segment], &entries, fresh,
+                                                memory_order_acq_rel, memory_order_acquire)) {
+      entries = fresh;
+    } else {
+      arena_free(fresh);
+    }
+  }
+  return entries != NULL ? &entries[offset] : NULL;
+}
+
+static void expire_hold(struct TimerEntry* timer);
+
+/// Records the seats of a reservation in its event's reservation index.
+/// @note The first time a held reservation is recorded, its timer is armed right after the seats become
+/// visible, so the expiry always finds them. Until then the timer is not pending, and a confirmation racing
+/// with the recording reports the hold as expired.
+/// @param event Event the reservation belongs to.
+/// @param reservation_id Id of the reservation.
+/// @param seats Seats of the reservation, owned by the index from now on.
+/// @return 0 if the reservation was recorded successfully, 1 otherwise.
+static int record_reservation(struct Event* event, unsigned int reservation_id, struct SeatList* seats) {
+  _Atomic(struct SeatList*)* entry = reservation_entry(event, reservation_id, true);
+  if (entry == NULL) {
+    return 1;
+  }
+
+  struct Hold* hold = atomic_load_explicit(&seats->hold, memory_order_relaxed);
+  bool arm = hold != NULL && hold->reservation_id == 0;
+  if (arm) hold->reservation_id = reservation_id;
+  atomic_store_explicit(entry, seats, memory_order_release);
+  if (arm) timer_schedule(&hold->timer, hold->ttl_ms, expire_hold);
+  return 0;
+}
+
+/// Removes a reservation from its event's reservation index.
+/// @note Readers inside an epoch may still hold the seats, so they must be freed through the epoch.
+/// @param event Event the reservation belongs to.
+/// @param reservation_id Id of the reservation.
+/// @return Seats of the reservation (now owned by the caller), NULL if there is no such reservation.
+static struct SeatList* take_reservation(struct Event* event, unsigned int reservation_id) {
+  _Atomic(struct SeatList*)* entry = reservation_entry(event, reservation_id, false);
+  return entry != NULL ? atomic_exchange_explicit(entry, NULL, memory_order_acq_rel) : NULL;
+}
+
+/// Checks that the seats of a reservation request exist and gets the stripes holding them.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats requested.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @param stripes Pointer to store the mask of the stripes holding the seats in.
+/// @return 0 if every seat exists, 1 otherwise.
+static int check_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, uint64_t* stripes) {
+  *stripes = 0;
+  for (size_t i = 0; i < num_seats; i++) {
+    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
+      fprintf(stderr, "Seat out of bounds\n");
+      return 1;
+    }
+    *stripes |= (uint64_t)1 << stripe_of(event, xs[i]);
+  }
+  return 0;
+}
+
+/// Claims seats with a compare-and-swap from 0 to CLAIMED_SEAT, without taking any lock.
+/// @note If any claim fails, the seats claimed so far are released, so either every seat is claimed or none.
+/// The claimed seats get their reservation id from publish_seats_lock_free, in the same write section, so
+/// readers never see CLAIMED_SEAT.
+/// @param event Event the seats belong to (always with full-width seats).
+/// @param num_seats Number of seats to claim (already checked to be within bounds).
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @param version Version of the write (see write_version).
+/// @note Must be called inside a write section of the event.
+/// @return 0 if every seat was claimed, 1 otherwise.
+static int claim_seats_lock_free(struct Event* event, size_t num_seats, size_t* xs, size_t* ys,
+                                 unsigned long version) {
+  atomic_uint* seats = event->data;
+  struct SeatUndo* undo = create_undo(event, version, num_seats);
+
+  for (size_t i = 0; i < num_seats; i++) {
+    unsigned int expected = 0;
+    if (!atomic_compare_exchange_strong_explicit(&seats[seat_index(event, xs[i], ys[i])], &expected, CLAIMED_SEAT,
+                                                 memory_order_acq_rel, memory_order_relaxed)) {
+      if (seat_repeated(xs, ys, i)) {
+        fprintf(stderr, "Seat repeated in reservation\n");
+      } else {
+        fprintf(stderr, "Seat already reserved\n");
+      }
+
+      while (i-- > 0) {
+        atomic_store_explicit(&seats[seat_index(event, xs[i], ys[i])], 0, memory_order_release);
+      }
+      arena_free(undo);
+      return 1;
+    }
+    if (undo != NULL) undo->seats[i] = (struct SeatValue){seat_index(event, xs[i], ys[i]), 0};
+  }
+  push_undo(event, undo);
+  return 0;
+}
+
+/// Writes the id of a reservation into the seats it claimed with claim_seats_lock_free.
+/// @note Must be called inside the write section the seats were claimed in.
+/// @param event Event the seats belong to.
+/// @param reservation_id Id of the reservation.
+/// @param num_seats Number of seats.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void publish_seats_lock_free(struct Event* event, unsigned int reservation_id, size_t num_seats, size_t* xs,
+                                    size_t* ys) {
+  atomic_uint* seats = event->data;
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_store_explicit(&seats[seat_index(event, xs[i], ys[i])], reservation_id, memory_order_release);
+  }
+}
+
+/// Releases seats claimed by claim_seats_lock_free.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats to release.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void unclaim_seats_lock_free(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  atomic_uint* seats = event->data;
+  begin_seat_write(event);
+  struct SeatUndo* undo = create_undo(event, write_version(), num_seats);
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t index = seat_index(event, xs[i], ys[i]);
+    if (undo != NULL) {
+      undo->seats[i] = (struct SeatValue){index, atomic_load_explicit(&seats[index], memory_order_relaxed)};
+    }
+    atomic_store_explicit(&seats[index], 0, memory_order_release);
+  }
+  push_undo(event, undo);
+  end_seat_write(event);
+}
+
+/// Marks seats claimed by claim_seats_lock_free as taken in the occupancy bitmap and the free seat counters.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats to mark.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void mark_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_or_explicit(seat_word(event, xs[i], ys[i]), seat_mask(ys[i]), memory_order_relaxed);
+  }
+  count_taken(event, num_seats, xs);
+}
+
+/// Clears seats marked by mark_seats from the occupancy bitmap and the free seat counters.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats to clear.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void unmark_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    atomic_fetch_and_explicit(seat_word(event, xs[i], ys[i]), ~seat_mask(ys[i]), memory_order_relaxed);
+  }
+  count_freed(event, num_seats, xs);
+}
+
+/// Creates a new reservation in the given event without taking any lock.
+/// @note The reservation id is only taken once every seat is claimed, so failed reservations take no id and the
+/// ids match the locked engine's. Seats are claimed in place, so the events of this engine always use full-width
+/// seats.
+/// The reservation is only recorded once its seats are marked, so a cancellation never misses a bit.
+/// @param event Event to create the reservation in.
+/// @param num_seats Number of seats to reserve (already checked to be within bounds).
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param seats Seat list of the reservation, recorded in the event's index on success.
+/// @param reservation_id Pointer to store the id of the reservation in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats_lock_free(struct Event* event, size_t num_seats, size_t* xs, size_t* ys,
+                                   struct SeatList* seats, unsigned int* reservation_id) {
+  begin_seat_write(event);
+  int claimed = claim_seats_lock_free(event, num_seats, xs, ys, write_version());
+  if (claimed == 0) {
+    *reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+    publish_seats_lock_free(event, *reservation_id, num_seats, xs, ys);
+  }
+  end_seat_write(event);
+  if (claimed != 0) {
+    return 1;
+  }
+
+  mark_seats(event, num_seats, xs, ys);
+  if (record_reservation(event, *reservation_id, seats) != 0) {
+    unmark_seats(event, num_seats, xs, ys);
+    unclaim_seats_lock_free(event, num_seats, xs, ys);
+    return 1;
+  }
+  return 0;
+}
+
+/// Clears the bits of the first seats of a reservation request from the occupancy bitmap.
+/// @note Must be called with the stripes of the seats locked.
+/// @param event Event the seats were claimed in.
+/// @param num_seats Number of seats to clear.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void clear_claims(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    _Atomic uint64_t* word = seat_word(event, xs[i], ys[i]);
+    atomic_store_explicit(word, atomic_load_explicit(word, memory_order_relaxed) & ~seat_mask(ys[i]),
+                          memory_order_relaxed);
+  }
+}
+
+/// Releases the seats of a reservation request claimed by claim_seats.
+/// @note Must be called with the stripes of the seats locked.
+/// @param event Event the seats were claimed in.
+/// @param num_seats Number of seats to release.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+static void release_claims(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  clear_claims(event, num_seats, xs, ys);
+  count_freed(event, num_seats, xs);
+}
+
+/// Claims seats in the occupancy bitmap, so a seat that is already taken (or repeated in the request) is
+/// found with a single bit test, and counts them as taken.
+/// @note Must be called with the stripes of the seats locked. If any claim fails, the seats claimed so far
+/// are released, so either every seat is claimed or none.
+/// @param event Event the seats belong to.
+/// @param num_seats Number of seats to claim (already checked to be within bounds).
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @return 0 if every seat was claimed, 1 otherwise.
+static int claim_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t i = 0; i < num_seats; i++) {
+    _Atomic uint64_t* word = seat_word(event, xs[i], ys[i]);
+    uint64_t bits = atomic_load_explicit(word, memory_order_relaxed);
+    if (bits & seat_mask(ys[i])) {
+      if (seat_repeated(xs, ys, i)) {
+        fprintf(stderr, "Seat repeated in reservation\n");
+      } else {
+        fprintf(stderr, "Seat already reserved\n");
+      }
+
+      clear_claims(event, i, xs, ys);
+      return 1;
+    }
+
+    atomic_store_explicit(word, bits | seat_mask(ys[i]), memory_order_relaxed);
+  }
+  count_taken(event, num_seats, xs);
+  return 0;
+}
+
+/// Checks whether a reservation id outgrew the seats of an event.
+/// @param event Event the reservation belongs to.
+/// @param reservation_id Id of the reservation.
+/// @return Width the seats must be widened to, 0 if the id already fits.
+static unsigned int width_needed(struct Event* event, unsigned int reservation_id) {
+  if (reservation_id <= max_seat_value(atomic_load_explicit(&event->seat_width, memory_order_relaxed))) return 0;
+  return reservation_id <= UINT16_MAX ? 2 : 4;
+}
+
+/// Writes a reservation id into claimed seats.
+/// @note Must be called with the stripes of the seats locked, once the id fits the seats.
+/// @param event Event the seats belong to.
+/// @param reservation_id Id of the reservation.
+/// @param num_seats Number of seats.
+/// @param xs Array of rows of the seats.
+/// @param ys Array of columns of the seats.
+/// @param version Version of the write (see write_version).
+/// @note Must be called inside a write section of the event.
+static void assign_seats(struct Event* event, unsigned int reservation_id, size_t num_seats, size_t* xs,
+                         size_t* ys, unsigned long version) {
+  unsigned int width = atomic_load_explicit(&event->seat_width, memory_order_relaxed);
+  void* data = event->data;
+  struct SeatUndo* undo = create_undo(event, version, num_seats);
+  for (size_t i = 0; i < num_seats; i++) {
+    size_t index = seat_index(event, xs[i], ys[i]);
+    if (undo != NULL) undo->seats[i] = (struct SeatValue){index, load_seat(data, width, index)};
+    store_seat(data, width, index, reservation_id);
+  }
+  push_undo(event, undo);
+}
+
+/// Creates a new reservation in the given event, with some stripes already locked.
+/// @param event Event to create the reservation in.
+/// @param num_seats Number of seats to reserve (already checked to be within bounds).
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param seats Seat list of the reservation, recorded in the event's index on success.
+/// @param reservation_id Pointer to store the id of the reservation in.
+/// @param stripes Stripes locked by the caller, covering the seats. Updated if every stripe had to be locked
+/// instead, and set to 0 if that failed (in which case none is locked).
+/// @return 0 if the reservation was created successfully, 1 otherwise (in which case the seats are free again).
+static int apply_reservation(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, struct SeatList* seats,
+                             unsigned int* reservation_id, uint64_t* stripes) {
+  if (claim_seats(event, num_seats, xs, ys) != 0) {
+    return 1;
+  }
+
+  *reservation_id = atomic_fetch_add(&event->reservations, 1) + 1;
+
+  // Widening needs every stripe. Stripes are only taken in ascending order, so the held ones are released
+  // first; the claimed bits keep the seats taken meanwhile.
+  if (width_needed(event, *reservation_id) != 0) {
+    if (*stripes != all_stripes(event)) {
+      uint64_t claimed = *stripes;
+      unlock_stripes(event, claimed);
+      *stripes = all_stripes(event);
+      if (lock_stripes(event, *stripes) != 0) {
+        // No stripe is held, so the claims are released under their own stripes again
+        *stripes = 0;
+        if (lock_stripes(event, claimed) == 0) {
+          release_claims(event, num_seats, xs, ys);
+          unlock_stripes(event, claimed);
+        }
+        return 1;
+      }
+    }
+
+    unsigned int width = width_needed(event, *reservation_id);
+    if (width != 0 && widen_seats(event, width) != 0) {
+      release_claims(event, num_seats, xs, ys);
+      return 1;
+    }
+  }
+
+  if (record_reservation(event, *reservation_id, seats) != 0) {
+    release_claims(event, num_seats, xs, ys);
+    return 1;
+  }
+
+  begin_seat_write(event);
+  assign_seats(event, *reservation_id, num_seats, xs, ys, write_version());
+  end_seat_write(event);
+  printf("reserve sucedido\n");
+  return 0;
+}
+
+/// Creates a new reservation in the given event, with the stripes of its seats locked.
+/// @param event Event to create the reservation in.
+/// @param num_seats Number of seats to reserve (already checked to be within bounds).
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param stripes Mask of the stripes holding the seats.
+/// @param seats Seat list of the reservation, recorded in the event's index on success.
+/// @param reservation_id Pointer to store the id of the reservation in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats_locked(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, uint64_t stripes,
+                                struct SeatList* seats, unsigned int* reservation_id) {
+  // Only the stripes holding the requested seats are locked, so reservations on other rows run in parallel
+  if (lock_stripes(event, stripes) != 0) {
+    return 1;
+  }
+
+  int result = apply_reservation(event, num_seats, xs, ys, seats, reservation_id, &stripes);
+  unlock_stripes(event, stripes);
+  return result;
+}
+
+/// Creates a new reservation in the given event.
+/// @param event Event to create the reservation in.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @param hold Expiry of the reservation if the seats are only held, NULL otherwise.
+/// @param reservation_id Pointer to store the id of the reservation in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys, struct Hold* hold,
+                         unsigned int* reservation_id) {
+  uint64_t stripes;
+  if (check_seats(event, num_seats, xs, ys, &stripes) != 0) {
+    return 1;
+  }
+
+  // Built before any lock is taken, to keep the critical sections short
+  struct SeatList* seats = create_seat_list(event, num_seats, xs, ys);
+  if (seats == NULL) {
+    return 1;
+  }
+  atomic_init(&seats->hold, hold);
+
+  int result = reserve_engine == RESERVE_LOCK_FREE
+                   ? reserve_seats_lock_free(event, num_seats, xs, ys, seats, reservation_id)
+                   : reserve_seats_locked(event, num_seats, xs, ys, stripes, seats, reservation_id);
+  if (result != 0) thread_slab_free(seats);
+  return result;
+}
+
+/// Applies a batch of reservations on one event under a single round of stripe locking.
+/// @note Must be called inside an epoch, with the event's combiner role held.
+/// @param event Event the requests are for.
+/// @param batch Requests of the batch, in arrival order.
+static void apply_batch(struct Event* event, struct ReserveRequest* batch) {
+  uint64_t stripes = 0;
+  size_t count = 0;
+  for (struct ReserveRequest* request = batch; request != NULL; request = request->next) {
+    uint64_t request_stripes;
+    request->result = 1;
+    if (check_seats(event, request->num_seats, request->xs, request->ys, &request_stripes) == 0) {
+      request->seats = create_seat_list(event, request->num_seats, request->xs, request->ys);
+      if (request->seats != NULL) {
+        request->result = 0;
+        stripes |= request_stripes;
+        count++;
+      }
+    }
+  }
+  if (count == 0) return;
+
+  // A batch whose ids may outgrow the seats locks every stripe up front, rather than relocking midway
+  if (width_needed(event, atomic_load(&event->reservations) + (unsigned int)count) != 0) {
+    stripes = all_stripes(event);
+  }
+  int lock_result = lock_stripes(event, stripes);
+
+  for (struct ReserveRequest* request = batch; request != NULL; request = request->next) {
+    if (request->result != 0) continue;
+    request->result = lock_result != 0 || stripes == 0
+                          ? 1
+                          : apply_reservation(event, request->num_seats, request->xs, request->ys, request->seats,
+                                              &request->reservation_id, &stripes);
+    if (request->result != 0) thread_slab_free(request->seats);
+  }
+
+  if (lock_result == 0) unlock_stripes(event, stripes);
+}
+
+/// Applies every reservation queued on an event, waking up their requesters.
+/// @note Must be called inside an epoch, with the event's combiner role held.
+/// @param event Event whose queued reservations are applied.
+static void combine_reservations(struct Event* event) {
+  // Requests are pushed newest first, so the batch is reversed to apply them in arrival order
+  struct ReserveRequest* batch = NULL;
+  struct ReserveRequest* pending = atomic_exchange_explicit(&event->reserve_queue, NULL, memory_order_acquire);
+  while (pending != NULL) {
+    struct ReserveRequest* next = pending->next;
+    pending->next = batch;
+    batch = pending;
+    pending = next;
+  }
+  apply_batch(event, batch);
+
+  // A requester may return as soon as it is woken up, taking its request with it
+  while (batch != NULL) {
+    struct ReserveRequest* next = batch->next;
+    sem_post(&batch->wakeup);
+    batch = next;
+  }
+}
+
+/// Gives up the combiner role of an event, applying the reservations queued meanwhile.
+/// @note Must be called inside an epoch, with the role held. Requesters queue before checking the role, and the
+/// queue is checked here after giving it up, so one of the two always applies a queued reservation.
+/// @param event Event whose combiner role is given up.
+static void release_combiner(struct Event* event) {
+  while (true) {
+    atomic_store(&event->combining, false);
+    if (atomic_load(&event->reserve_queue) == NULL || atomic_exchange(&event->combining, true)) return;
+    combine_reservations(event);
+  }
+}
+
+/// Creates a new reservation in the given event, batching it with the others made on the event meanwhile.
+/// @note Each requester waits out its own state access first, so accesses overlap and nothing waits for another
+/// event. If no requester is combining for the event, the reservation is made right away; otherwise it is queued
+/// on the event, and the combiner locks the event's stripes once for every reservation queued, while their
+/// requesters sleep until theirs is applied. So a hot event pays one lock handoff per batch rather than per
+/// reservation. The queue is only touched inside an epoch, which keeps the event's memory alive.
+/// Must be called outside of any epoch, and with no lock held. Only used by the locked engine, whose stripes the
+/// batch shares.
+/// @param event_id The ID of the event to create the reservation in.
+/// @param num_seats Number of seats to reserve.
+/// @param xs Array of rows of the seats to reserve.
+/// @param ys Array of columns of the seats to reserve.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+static int reserve_seats_combined(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  // Seats that do not exist are refused before the state access is paid for
+  epoch_enter();
+  struct Event* event = get_event(shard_of(event_id), event_id);
+  uint64_t stripes;
+  bool valid = event != NULL && check_seats(event, num_seats, xs, ys, &stripes) == 0;
+  if (event == NULL) fprintf(stderr, "Event not found\n");
+  epoch_exit();
+  if (!valid) return 1;
+
+  event = enter_event(event_id);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
+    return 1;
+  }
+
+  if (atomic_load(&event->reserve_queue) == NULL && !atomic_exchange(&event->combining, true)) {
+    unsigned int reservation_id;
+    int result = reserve_seats(event, num_seats, xs, ys, NULL, &reservation_id);
+    release_combiner(event);
+    epoch_exit();
+    return result;
+  }
+
+  struct ReserveRequest request = {.num_seats = num_seats, .xs = xs, .ys = ys};
+  if (sem_init(&request.wakeup, 0, 0) != 0) {
+    fprintf(stderr, "Error initializing reservation request\n");
+    epoch_exit();
+    return 1;
+  }
+  request.next = atomic_load(&event->reserve_queue);
+  while (!atomic_compare_exchange_weak(&event->reserve_queue, &request.next, &request)) {
+  }
+  if (!atomic_exchange(&event->combining, true)) {
+    combine_reservations(event);
+    release_combiner(event);
+  }
+  epoch_exit();
+
+  while (sem_wait(&request.wakeup) != 0) {
+  }
+  sem_destroy(&request.wakeup);
+  return request.result;
+}
+
+/// Finds the first run of free seats in a row.
+/// @note Scans the occupancy bitmap, skipping whole runs of free or taken seats (up to 64 at a time) per step.
+/// @param event Event to search.
+/// @param row Row to search.
+/// @param num_seats Length of the run.
+/// @return Column where the run starts, 0 if the row has no such run.
+static size_t find_free_run(struct Event* event, size_t row, size_t num_seats) {
+  size_t run = 0;  // Free seats right before the current position
+  for (size_t w = 0; w < event->row_words; w++) {
+    uint64_t taken = taken_seats(event, row, w);
+    size_t bit = 0;
+    while (bit < 64) {
+      uint64_t rest = taken >> bit;
+      size_t free_len = rest == 0 ? 64 - bit : (size_t)__builtin_ctzll(rest);
+      run += free_len;
+      bit += free_len;
+      if (run >= num_seats) return w * 64 + bit - run + 1;
+      if (bit == 64) break;
+
+      // Zeros shifted in from the top become ones, so the taken run ends within the word unless it fills it
+      run = 0;
+      uint64_t untaken = ~(taken >> bit);
+      if (untaken == 0) break;
+      bit += (size_t)__builtin_ctzll(untaken);
+    }
+  }
+  return 0;
+}
+
+/// Picks the best available seats of an event: the first run of adjacent free seats, front rows first,
+/// or failing that the free seats of the fewest consecutive rows.
+/// @note The seats are read without locks, so they may be taken before they are reserved.
+/// @param event Event to pick the seats from.
+/// @param num_seats Number of seats to pick.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return 0 if the seats were picked, 1 if the event does not have enough free seats.
+static int pick_best_seats(struct Event* event, size_t num_seats, size_t* xs, size_t* ys) {
+  for (size_t row = 1; row <= event->rows; row++) {
+    if (row_free_seats(event, row) < num_seats) continue;
+
+    size_t col = find_free_run(event, row, num_seats);
+    if (col != 0) {
+      for (size_t i = 0; i < num_seats; i++) {
+        xs[i] = row;
+        ys[i] = col + i;
+      }
+      return 0;
+    }
+  }
+
+  // Sliding window over the rows, on a snapshot of their free seats so the window stays consistent
+  size_t* free_per_row = malloc(event->rows * sizeof(size_t));
+  if (free_per_row == NULL) {
+    fprintf(stderr, "Error allocating memory for seat search\n");
+    return 1;
+  }
+  size_t best_first = 0, best_span = SIZE_MAX, first = 0, window = 0;
+  for (size_t last = 0; last < event->rows; last++) {
+    free_per_row[last] = row_free_seats(event, last + 1);
+    window += free_per_row[last];
+    while (window - free_per_row[first] >= num_seats) {
+      window -= free_per_row[first++];
+    }
+    if (window >= num_seats && last - first + 1 < best_span) {
+      best_first = first;
+      best_span = last - first + 1;
+    }
+  }
+  free(free_per_row);
+  if (best_span == SIZE_MAX) return 1;
+
+  // Seats may have been taken since the snapshot, so keep collecting past the window if needed
+  size_t picked = 0;
+  for (size_t k = 0; k < event->rows && picked < num_seats; k++) {
+    size_t row = (best_first + k) % event->rows + 1;
+    for (size_t w = 0; w < event->row_words && picked < num_seats; w++) {
+      for (uint64_t bits = ~taken_seats(event, row, w); bits != 0 && picked < num_seats; bits &= bits - 1) {
+        xs[picked] = row;
+        ys[picked++] = w * 64 + (size_t)__builtin_ctzll(bits) + 1;
+      }
+    }
+  }
+  return picked == num_seats ? 0 : 1;
+}
+
+int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-  return get_event(event_list, event_id, from, to);
-}
+  if (reserve_engine == RESERVE_LOCKED) return reserve_seats_combined(event_id, num_seats, xs, ys);
 
-/// Gets the index of a seat.
-/// @note This function assumes that the seat exists.
-/// @param event Event to get the seat index from.
-/// @param row Row of the seat.
-/// @param col Column of the seat.
-/// @return Index of the seat.
-static size_t seat_index(struct Event* event, size_t row, size_t col) { return (row - 1) * event->cols + col - 1; }
+  struct Event* event = enter_event(event_id);
 
-int ems_init(unsigned int delay_us) {
-  if (event_list != NULL) {
-    fprintf(stderr, "EMS state has already been initialized\n");
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
     return 1;
   }
 
-  event_list = create_list();
-  state_access_delay_us = delay_us;
+  unsigned int reservation_id;
+  int result = reserve_seats(event, num_seats, xs, ys, NULL, &reservation_id);
+  epoch_exit();
+  return result;
+}
 
-  return event_list == NULL;
+// Seats requested from one event as part of a transaction
+struct TransactionGroup {
+  unsigned int event_id;
+  struct Event* event;
+  size_t num_seats;
+  size_t* xs;
+  size_t* ys;
+  uint64_t stripes;
+  unsigned int reservation_id;
+  struct SeatList* seats;
+};
+
+static int compare_group_event_id(const void* a, const void* b) {
+  unsigned int id_a = ((const struct TransactionGroup*)a)->event_id;
+  unsigned int id_b = ((const struct TransactionGroup*)b)->event_id;
+  return (id_a > id_b) - (id_a < id_b);
 }
 
-int ems_terminate() {
-  if (event_list == NULL) {
-    fprintf(stderr, "EMS state must be initialized\n");
-    return 1;
+/// Reserves the seats of every group of a transaction without taking any lock.
+/// @note Each group's seats are claimed in place, and every claim is undone if any group fails.
+/// @return 0 if every group was reserved, 1 otherwise.
+static int reserve_transaction_lock_free(struct TransactionGroup* groups, size_t num_groups) {
+  // Every event's write section stays open until all claims are done, so reports see all of them or none
+  for (size_t g = 0; g < num_groups; g++) begin_seat_write(groups[g].event);
+  unsigned long version = write_version();
+
+  for (size_t g = 0; g < num_groups; g++) {
+    if (claim_seats_lock_free(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys, version) != 0) {
+      for (size_t i = 0; i < num_groups; i++) end_seat_write(groups[i].event);
+      while (g-- > 0) unclaim_seats_lock_free(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys);
+      return 1;
+    }
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
+  // Ids are only taken once the whole transaction holds its seats, so a failed one takes none
+  for (size_t g = 0; g < num_groups; g++) {
+    groups[g].reservation_id = atomic_fetch_add(&groups[g].event->reservations, 1) + 1;
+    publish_seats_lock_free(groups[g].event, groups[g].reservation_id, groups[g].num_seats, groups[g].xs,
+                            groups[g].ys);
   }
+  for (size_t g = 0; g < num_groups; g++) end_seat_write(groups[g].event);
 
-  free_list(event_list);
-  pthread_rwlock_unlock(&event_list->rwl);
+  for (size_t g = 0; g < num_groups; g++) {
+    mark_seats(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys);
+  }
+
+  for (size_t g = 0; g < num_groups; g++) {
+    if (record_reservation(groups[g].event, groups[g].reservation_id, groups[g].seats) != 0) {
+      while (g-- > 0) take_reservation(groups[g].event, groups[g].reservation_id);
+      for (g = 0; g < num_groups; g++) {
+        unmark_seats(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys);
+        unclaim_seats_lock_free(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys);
+      }
+      return 1;
+    }
+  }
   return 0;
 }
 
-int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols) {
-  if (event_list == NULL) {
+/// Reserves the seats of every group of a transaction, with every stripe of their events locked.
+/// @note Whole events are locked, so seats can be widened without letting go of any lock; events are
+/// locked in id order, so concurrent transactions cannot deadlock.
+/// @return 0 if every group was reserved, 1 otherwise.
+static int reserve_transaction_locked(struct TransactionGroup* groups, size_t num_groups) {
+  for (size_t g = 0; g < num_groups; g++) {
+    if (lock_stripes(groups[g].event, all_stripes(groups[g].event)) != 0) {
+      while (g-- > 0) unlock_stripes(groups[g].event, all_stripes(groups[g].event));
+      return 1;
+    }
+  }
+
+  int result = 0;
+  size_t claimed = 0;
+  for (; claimed < num_groups; claimed++) {
+    if (claim_seats(groups[claimed].event, groups[claimed].num_seats, groups[claimed].xs, groups[claimed].ys) != 0) {
+      result = 1;
+      break;
+    }
+  }
+
+  for (size_t g = 0; g < num_groups && result == 0; g++) {
+    groups[g].reservation_id = atomic_fetch_add(&groups[g].event->reservations, 1) + 1;
+    unsigned int width = width_needed(groups[g].event, groups[g].reservation_id);
+    if (width != 0 && widen_seats(groups[g].event, width) != 0) result = 1;
+  }
+
+  size_t recorded = 0;
+  for (; recorded < num_groups && result == 0; recorded++) {
+    if (record_reservation(groups[recorded].event, groups[recorded].reservation_id, groups[recorded].seats) != 0) {
+      result = 1;
+      break;
+    }
+  }
+
+  if (result == 0) {
+    // Every event's write section stays open until all seats are assigned, so reports see all of them or none
+    for (size_t g = 0; g < num_groups; g++) begin_seat_write(groups[g].event);
+    unsigned long version = write_version();
+    for (size_t g = 0; g < num_groups; g++) {
+      assign_seats(groups[g].event, groups[g].reservation_id, groups[g].num_seats, groups[g].xs, groups[g].ys,
+                   version);
+    }
+    for (size_t g = 0; g < num_groups; g++) end_seat_write(groups[g].event);
+  } else {
+    while (recorded-- > 0) take_reservation(groups[recorded].event, groups[recorded].reservation_id);
+    while (claimed-- > 0) release_claims(groups[claimed].event, groups[claimed].num_seats, groups[claimed].xs,
+                                         groups[claimed].ys);
+  }
+
+  for (size_t g = num_groups; g-- > 0;) {
+    unlock_stripes(groups[g].event, all_stripes(groups[g].event));
+  }
+  return result;
+}
+
+int ems_reserve_transaction(size_t num_groups, unsigned int* event_ids, size_t* num_seats, size_t* xs, size_t* ys) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_wrlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  if (num_groups == 0 || num_groups > MAX_TRANSACTION_EVENTS) {
+    fprintf(stderr, "Invalid number of events\n");
     return 1;
   }
 
-  if (get_event_with_delay(event_id, event_list->head, event_list->tail) != NULL) {
-    fprintf(stderr, "Event already exists\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+  struct TransactionGroup groups[MAX_TRANSACTION_EVENTS];
+  size_t offset = 0;
+  for (size_t g = 0; g < num_groups; g++) {
+    groups[g].event_id = event_ids[g];
+    groups[g].num_seats = num_seats[g];
+    groups[g].xs = xs + offset;
+    groups[g].ys = ys + offset;
+    offset += num_seats[g];
   }
+  qsort(groups, num_groups, sizeof(struct TransactionGroup), compare_group_event_id);
 
-  struct Event* event = malloc(sizeof(struct Event));
+  // Every access is issued before waiting for any, so the transaction pays the state's delay once, not per event
+  struct StateFetch fetches[MAX_TRANSACTION_EVENTS];
+  for (size_t g = 0; g < num_groups; g++) {
+    if (g > 0 && groups[g].event_id == groups[g - 1].event_id) {
+      fprintf(stderr, "Event repeated in transaction\n");
+      return 1;
+    }
+    start_fetch(&fetches[g], groups[g].event_id);
+  }
 
-  if (event == NULL) {
-    fprintf(stderr, "Error allocating memory for event\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    return 1;
+  for (size_t g = 0; g < num_groups; g++) {
+    await_fetch(&fetches[g]);
   }
 
-  event->id = event_id;
-  event->rows = num_rows;
-  event->cols = num_cols;
-  event->reservations = 0;
-  if (pthread_mutex_init(&event->mutex, NULL) != 0) {
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
+  epoch_enter();
+  for (size_t g = 0; g < num_groups; g++) {
+    groups[g].event = resolve_fetch(&fetches[g]);
+    if (groups[g].event == NULL) {
+      fprintf(stderr, "Event not found\n");
+      epoch_exit();
+      return 1;
+    }
+
+    if (check_seats(groups[g].event, groups[g].num_seats, groups[g].xs, groups[g].ys, &groups[g].stripes) != 0) {
+      epoch_exit();
+      return 1;
+    }
   }
-  event->data = calloc(num_rows * num_cols, sizeof(unsigned int));
 
-  if (event->data == NULL) {
-    fprintf(stderr, "Error allocating memory for event data\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event);
-    return 1;
+  int result = 0;
+  size_t built = 0;
+  for (; built < num_groups; built++) {
+    groups[built].seats = create_seat_list(groups[built].event, groups[built].num_seats, groups[built].xs,
+                                           groups[built].ys);
+    if (groups[built].seats == NULL) {
+      result = 1;
+      break;
+    }
   }
 
-  if (append_to_list(event_list, event) != 0) {
-    fprintf(stderr, "Error appending event to list\n");
-    pthread_rwlock_unlock(&event_list->rwl);
-    free(event->data);
-    free(event);
+  if (result == 0) {
+    result = reserve_engine == RESERVE_LOCK_FREE ? reserve_transaction_lock_free(groups, num_groups)
+                                                 : reserve_transaction_locked(groups, num_groups);
+  }
+  if (result != 0) {
+    // Seats recorded before the transaction failed may have been seen by a reader of the index
+    while (built-- > 0) epoch_retire(groups[built].seats, thread_slab_free);
+  }
+  epoch_exit();
+  return result;
+}
+
+/// Frees the seats of a reservation already taken out of its event's reservation index.
+/// @param event Event the reservation belongs to.
+/// @param seats Seats of the reservation.
+/// @return 0 if the seats were freed successfully, 1 otherwise (in which case none was).
+static int release_seats(struct Event* event, struct SeatList* seats) {
+  if (reserve_engine == RESERVE_LOCK_FREE) {
+    atomic_uint* data = event->data;
+    begin_seat_write(event);
+    struct SeatUndo* undo = create_undo(event, write_version(), seats->num_seats);
+    // The bit goes before the seat, so a new claim on the seat cannot have its bit cleared
+    for (size_t i = 0; i < seats->num_seats; i++) {
+      size_t row = seats->seats[i] / event->cols, col = seats->seats[i] % event->cols;
+      atomic_fetch_and_explicit(&event->occupied[row * event->row_words + col / 64], ~((uint64_t)1 << (col % 64)),
+                                memory_order_relaxed);
+      atomic_fetch_add_explicit(&event->row_free[row], 1, memory_order_relaxed);
+      if (undo != NULL) {
+        undo->seats[i] =
+            (struct SeatValue){seats->seats[i], atomic_load_explicit(&data[seats->seats[i]], memory_order_relaxed)};
+      }
+      atomic_store_explicit(&data[seats->seats[i]], 0, memory_order_release);
+    }
+    atomic_fetch_add_explicit(&event->free_count, seats->num_seats, memory_order_relaxed);
+    push_undo(event, undo);
+    end_seat_write(event);
+    return 0;
+  }
+
+  uint64_t stripes = 0;
+  for (size_t i = 0; i < seats->num_seats; i++) {
+    stripes |= (uint64_t)1 << stripe_of(event, seats->seats[i] / event->cols + 1);
+  }
+
+  if (lock_stripes(event, stripes) != 0) {
     return 1;
   }
 
-  pthread_rwlock_unlock(&event_list->rwl);
-  printf("fiz o create\n");
+  unsigned int width = atomic_load_explicit(&event->seat_width, memory_order_relaxed);
+  void* data = event->data;
+  begin_seat_write(event);
+  struct SeatUndo* undo = create_undo(event, write_version(), seats->num_seats);
+  for (size_t i = 0; i < seats->num_seats; i++) {
+    size_t row = seats->seats[i] / event->cols, col = seats->seats[i] % event->cols;
+    if (undo != NULL) undo->seats[i] = (struct SeatValue){seats->seats[i], load_seat(data, width, seats->seats[i])};
+    store_seat(data, width, seats->seats[i], 0);
+    _Atomic uint64_t* word = &event->occupied[row * event->row_words + col / 64];
+    atomic_store_explicit(word, atomic_load_explicit(word, memory_order_relaxed) & ~((uint64_t)1 << (col % 64)),
+                          memory_order_relaxed);
+    atomic_fetch_add_explicit(&event->row_free[row], 1, memory_order_relaxed);
+  }
+  atomic_fetch_add_explicit(&event->free_count, seats->num_seats, memory_order_relaxed);
+  push_undo(event, undo);
+  end_seat_write(event);
+  unlock_stripes(event, stripes);
   return 0;
 }
 
-int ems_reserve(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
-  if (event_list == NULL) {
+int ems_cancel(unsigned int event_id, unsigned int reservation_id) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    return 1;
-  }
-
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
-
-  pthread_rwlock_unlock(&event_list->rwl);
+  struct Event* event = enter_event(event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
+    epoch_exit();
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  // Taking the reservation out of the index first means concurrent cancellations of it cannot both succeed
+  struct SeatList* seats = take_reservation(event, reservation_id);
+  if (seats == NULL) {
+    fprintf(stderr, "Reservation not found\n");
+    epoch_exit();
     return 1;
   }
 
-  for (size_t i = 0; i < num_seats; i++) {
-    if (xs[i] <= 0 || xs[i] > event->rows || ys[i] <= 0 || ys[i] > event->cols) {
-      fprintf(stderr, "Seat out of bounds\n");
-      pthread_mutex_unlock(&event->mutex);
-      return 1;
-    }
+  if (release_seats(event, seats) != 0) {
+    record_reservation(event, reservation_id, seats);
+    epoch_exit();
+    return 1;
   }
 
-  for (size_t i = 0; i < event->rows * event->cols; i++) {
-    for (size_t j = 0; j < num_seats; j++) {
-      if (seat_index(event, xs[j], ys[j]) != i) {
-        continue;
-      }
-
-      if (event->data[i] != 0) {
-        fprintf(stderr, "Seat already reserved\n");
-        pthread_mutex_unlock(&event->mutex);
-        return 1;
-      }
+  // Whoever cancels the timer owns the hold: one already firing is left for the expiry to free, and one
+  // a concurrent confirmation stopped first is left for it. Confirmations may still be looking at either.
+  struct Hold* hold = atomic_load(&seats->hold);
+  if (hold != NULL && timer_cancel(&hold->timer) == 0) epoch_retire(hold, free);
+  epoch_retire(seats, thread_slab_free);
+  epoch_exit();
+  return 0;
+}
 
-      break;
-    }
+/// Releases the seats of a hold whose time ran out.
+/// @note Called from the wheel thread. The hold is only released if it is still in its event's index:
+/// a hold that was cancelled, or whose event was deleted, is simply freed.
+/// @param timer Timer of the hold.
+static void expire_hold(struct TimerEntry* timer) {
+  struct Hold* hold = (struct Hold*)timer;
+
+  epoch_enter();
+  struct Event* event = get_event(shard_of(hold->event_id), hold->event_id);
+  _Atomic(struct SeatList*)* entry = event != NULL ? reservation_entry(event, hold->reservation_id, false) : NULL;
+  struct SeatList* seats = entry != NULL ? atomic_load_explicit(entry, memory_order_acquire) : NULL;
+  // The compare-and-swap loses to a cancellation taking the seats out of the index first
+  if (seats != NULL && (atomic_load(&seats->hold) != hold || !atomic_compare_exchange_strong(entry, &seats, NULL))) {
+    seats = NULL;
   }
 
-  unsigned int reservation_id = ++event->reservations;
-
-  for (size_t i = 0; i < num_seats; i++) {
-    event->data[seat_index(event, xs[i], ys[i])] = reservation_id;
+  if (seats != NULL) {
+    if (release_seats(event, seats) != 0) {
+      // The seats stay taken, as a plain reservation that can still be cancelled
+      fprintf(stderr, "Error releasing expired hold\n");
+      atomic_store(&seats->hold, NULL);
+      record_reservation(event, hold->reservation_id, seats);
+    } else {
+      epoch_retire(seats, thread_slab_free);
+    }
   }
-
-  pthread_mutex_unlock(&event->mutex);
-  printf("reserve sucedido\n");
-  return 0;
+  // A cancellation or confirmation that found the hold before the timer fired may still be looking at it
+  epoch_retire(hold, free);
+  epoch_exit();
 }
 
-int ems_show(int out_fd, unsigned int event_id) {
-  int Invalid = -1;
-  char errorBuffer[pipeBuffer];
-  char showSizeBuffer[pipeBuffer];
-  if (event_list == NULL) {
+int ems_hold(unsigned int event_id, unsigned int ttl_ms, size_t num_seats, size_t* xs, size_t* ys,
+             unsigned int* hold_id) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
-    snprintf(errorBuffer, sizeof(errorBuffer), "%d", Invalid);
-    write(out_fd, errorBuffer, strlen(errorBuffer));
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
-    snprintf(errorBuffer, sizeof(errorBuffer), "%d", Invalid);
-    write(out_fd, errorBuffer, strlen(errorBuffer));
+  if (ttl_ms == 0) {
+    fprintf(stderr, "Invalid hold time\n");
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  struct Hold* hold = calloc(1, sizeof(struct Hold));
+  if (hold == NULL) {
+    fprintf(stderr, "Error allocating memory for hold\n");
+    return 1;
+  }
+  hold->event_id = event_id;
+  hold->ttl_ms = ttl_ms;
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  struct Event* event = enter_event(event_id);
 
   if (event == NULL) {
     fprintf(stderr, "Event not found\n");
-    snprintf(errorBuffer, sizeof(errorBuffer), "%d", Invalid);
-    write(out_fd, errorBuffer, strlen(errorBuffer));
+    epoch_exit();
+    free(hold);
     return 1;
   }
 
-  //snprintf(showSizeBuffer, sizeof(showSizeBuffer), "%d ", size);
-  //write(out_fd, showSizeBuffer, strlen(showSizeBuffer));
+  // Once recorded, the hold belongs to its timer and may expire at any time, so its id comes back apart
+  int result = reserve_seats(event, num_seats, xs, ys, hold, hold_id);
+  epoch_exit();
+  if (result != 0) free(hold);
+  return result;
+}
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
-    snprintf(errorBuffer, sizeof(errorBuffer), "%d", Invalid);
-    write(out_fd, errorBuffer, strlen(errorBuffer));
+int ems_confirm(unsigned int event_id, unsigned int hold_id) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
-   memset(errorBuffer, 0, sizeof(errorBuffer));
-  size_t size = sizeof(int) + (2* sizeof(size_t)) + event->cols * event->rows * sizeof(unsigned int);
-  snprintf(errorBuffer, sizeof(errorBuffer), "%zu", size);
 
-  if (write(out_fd, errorBuffer, strlen(errorBuffer)) == -1) {
-    perror("Error writing to file descriptor");
-    pthread_mutex_unlock(&event->mutex);
+  struct Event* event = enter_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
     return 1;
   }
 
-  // Alocar o buffer para enviar na resp_pipe
-  size_t buffer_size = sizeof(int) + (2* sizeof(size_t)) + event->cols * event->rows * sizeof(unsigned int);
-  char *buffer = (char *)malloc(buffer_size);
-  unsigned int seats[event->cols * event->rows];
+  // The seats already carry the reservation id, so confirming only has to stop the timer
+  _Atomic(struct SeatList*)* entry = reservation_entry(event, hold_id, false);
+  struct SeatList* seats = entry != NULL ? atomic_load_explicit(entry, memory_order_acquire) : NULL;
+  struct Hold* hold = seats != NULL ? atomic_load(&seats->hold) : NULL;
+  if (hold == NULL) {
+    fprintf(stderr, "Hold not found\n");
+    epoch_exit();
+    return 1;
+  }
 
-  // Adicionar 0 ao buffer (primeiros sizeof(int) bytes)
-  int answer = 0;
-  memcpy(buffer, &answer, sizeof(int));
+  // Only one of the confirmations, cancellations and the expiry racing for the hold gets to stop its timer
+  if (timer_cancel(&hold->timer) != 0) {
+    fprintf(stderr, "Hold expired\n");
+    epoch_exit();
+    return 1;
+  }
+  atomic_store(&seats->hold, NULL);
 
-  // Adicionar o número de eventos ao buffer (primeiros sizeof(size_t) bytes)
-  memcpy(buffer + sizeof(int), &event->rows, sizeof(size_t));
-  memcpy(buffer + sizeof(int) + sizeof(size_t), &event->cols, sizeof(size_t));
+  epoch_retire(hold, free);
+  epoch_exit();
+  return 0;
+}
 
-  for (size_t i = 1; i <= event->rows; i++) {
-    for (size_t j = 1; j <= event->cols; j++) {
-      // Use snprintf para escrever no buffer
-      seats[(i - 1) * event->cols + (j - 1)] = event->data[seat_index(event, i, j)];
+/// Copies seats into a buffer as unsigned ints, whatever their width in memory.
+/// @note The seats are read one by one with relaxed loads, so writers may change them during the copy.
+/// @param out Buffer with room for num_seats unsigned ints (need not be aligned).
+/// @param data Seat array.
+/// @param width Bytes per seat in data.
+/// @param num_seats Number of seats to copy.
+static void copy_seats(char* out, void* data, unsigned int width, size_t num_seats) {
+  switch (width) {
+    case 1:
+      for (size_t i = 0; i < num_seats; i++) {
+        unsigned int seat = atomic_load_explicit(&((_Atomic uint8_t*)data)[i], memory_order_relaxed);
+        memcpy(out + i * sizeof(unsigned int), &seat, sizeof(unsigned int));
+      }
+      break;
+    case 2:
+      for (size_t i = 0; i < num_seats; i++) {
+        unsigned int seat = atomic_load_explicit(&((_Atomic uint16_t*)data)[i], memory_order_relaxed);
+        memcpy(out + i * sizeof(unsigned int), &seat, sizeof(unsigned int));
+      }
+      break;
+    default:
+      for (size_t i = 0; i < num_seats; i++) {
+        unsigned int seat = atomic_load_explicit(&((atomic_uint*)data)[i], memory_order_relaxed);
+        memcpy(out + i * sizeof(unsigned int), &seat, sizeof(unsigned int));
+      }
+      break;
+  }
+}
+
+/// Copies every seat of an event into a buffer as unsigned ints, as a consistent snapshot taken without
+/// blocking reservations: the copy is retried whenever a write overlapped it.
+/// @note Must be called inside an epoch, which keeps a seat array replaced by widening readable. If writers keep
+/// interleaving, the copy stops retrying: a locked-engine event is copied with its stripes locked, since that
+/// engine only writes seats under them, and a lock-free one with new writers held off at begin_seat_write.
+/// @param out Buffer with room for rows * cols unsigned ints (need not be aligned).
+/// @param event Event whose seats are copied.
+/// @param undo Pointer to store the newest undo record of the event in, as of the snapshot (may be NULL).
+/// @return 0 if the seats were copied successfully, 1 otherwise.
+static int snapshot_seats(char* out, struct Event* event, struct SeatUndo** undo) {
+  size_t num_seats = event->rows * event->cols;
+  for (int attempt = 0; attempt < SHOW_SNAPSHOT_ATTEMPTS; attempt++) {
+    // Sequentially consistent, so a write this misses is one that sees the report registered (see write_version)
+    uint64_t before = atomic_load(&event->seat_seq);
+    if ((before & SEAT_SEQ_WRITERS) != 0) {
+      sched_yield();
+      continue;
     }
+
+    // The width goes first: the array loaded after it is at least as wide, so the copy stays within bounds
+    unsigned int width = atomic_load_explicit(&event->seat_width, memory_order_acquire);
+    copy_seats(out, event->data, width, num_seats);
+    if (undo != NULL) *undo = atomic_load_explicit(&event->undo, memory_order_acquire);
+
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&event->seat_seq, memory_order_relaxed) == before) return 0;
   }
 
-  memcpy(buffer + sizeof(int) + sizeof(size_t) + sizeof(size_t) , seats, (event->cols * event->rows) * sizeof(unsigned int)); 
-  for (size_t j = 0; j < buffer_size; j++) {
-    //printf("N:%u \n", buffer[j]);
+  // Writers keep overlapping the copy, so they are held off instead. Lock-free writers take no stripes, so they
+  // are stopped at begin_seat_write, and the copy starts once the writes in progress are done.
+  if (reserve_engine == RESERVE_LOCK_FREE) {
+    atomic_fetch_add(&event->snapshot_waiters, 1);
+    while ((atomic_load(&event->seat_seq) & SEAT_SEQ_WRITERS) != 0) sched_yield();
+    copy_seats(out, event->data, atomic_load_explicit(&event->seat_width, memory_order_relaxed), num_seats);
+    if (undo != NULL) *undo = atomic_load_explicit(&event->undo, memory_order_acquire);
+    atomic_fetch_sub(&event->snapshot_waiters, 1);
+    return 0;
   }
-  if (write(out_fd, buffer, buffer_size) == -1) {
-    perror("Error writing to file descriptor");
-    free(buffer);
-    pthread_mutex_unlock(&event->mutex);
+
+  if (lock_stripes(event, all_stripes(event)) != 0) {
     return 1;
   }
-  
-  pthread_mutex_unlock(&event->mutex);
+  copy_seats(out, event->data, atomic_load_explicit(&event->seat_width, memory_order_relaxed), num_seats);
+  if (undo != NULL) *undo = atomic_load_explicit(&event->undo, memory_order_acquire);
+  unlock_stripes(event, all_stripes(event));
   return 0;
 }
 
-int ems_list_events(int out_fd) {
-  size_t num_events = 0;
-  int Invalid = 1;
-  char errorBuffer[pipeBuffer];
-  if (event_list == NULL) {
+/// Rolls a snapshot of seats back to the given version, undoing every write logged after it.
+/// @note Must be called inside an epoch, which keeps the records readable while they are trimmed.
+/// @param out Seats copied by snapshot_seats (need not be aligned).
+/// @param undo Newest undo record, as stored by snapshot_seats.
+/// @param version Version to roll back to.
+static void undo_seats(char* out, struct SeatUndo* undo, unsigned long version) {
+  // Newest first, so a seat written several times ends up with its value from before the oldest write undone
+  for (; undo != NULL; undo = atomic_load_explicit(&undo->next, memory_order_acquire)) {
+    if (undo->version <= version) continue;
+    for (size_t i = 0; i < undo->num_seats; i++) {
+      memcpy(out + undo->seats[i].index * sizeof(unsigned int), &undo->seats[i].value, sizeof(unsigned int));
+    }
+  }
+}
+
+/// Unlinks the undo records no report can need anymore, retiring them.
+/// @note Must be called with the report mutex held, so only one caller trims at a time.
+/// @param event Event whose undo records are trimmed.
+/// @param horizon Oldest version a report may still be rolled back to.
+static void trim_undo(struct Event* event, unsigned long horizon) {
+  struct SeatUndo* prev = NULL;
+  struct SeatUndo* undo = atomic_load_explicit(&event->undo, memory_order_acquire);
+  while (undo != NULL) {
+    struct SeatUndo* next = atomic_load_explicit(&undo->next, memory_order_acquire);
+    if (undo->version > horizon) {
+      prev = undo;
+      undo = next;
+      continue;
+    }
+
+    if (prev == NULL) {
+      // Writers push at the head, so it is unlinked with a compare-and-swap, reloaded if they got there first
+      if (!atomic_compare_exchange_strong_explicit(&event->undo, &undo, next, memory_order_acq_rel,
+                                                   memory_order_acquire)) {
+        continue;
+      }
+    } else {
+      atomic_store_explicit(&prev->next, next, memory_order_release);
+    }
+    epoch_retire(undo, arena_free);
+    undo = next;
+  }
+}
+
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t* xs, size_t* ys) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  if (num_seats == 0 || num_seats > MAX_RESERVATION_SIZE) {
+    fprintf(stderr, "Invalid number of seats\n");
     return 1;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
+  struct Event* event = enter_event(event_id);
 
-  if (current == NULL) {
-    fprintf(stderr, "No events\n");
-    snprintf(errorBuffer, sizeof(errorBuffer), "%d", Invalid);
-    write(out_fd, errorBuffer, strlen(errorBuffer));
-    pthread_rwlock_unlock(&event_list->rwl);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
     return 1;
   }
 
-  while (1) {
-    num_events++;
-
-    if (current == to) {
+  // Another reservation may take the picked seats before they are claimed, in which case they are picked
+  // again without paying for the lookup a second time
+  int result = 1;
+  for (int attempt = 0; attempt < BEST_SEATS_ATTEMPTS && result != 0; attempt++) {
+    if (pick_best_seats(event, num_seats, xs, ys) != 0) {
+      fprintf(stderr, "Not enough free seats\n");
       break;
     }
-
-    current = current->next;
+    unsigned int reservation_id;
+    result = reserve_seats(event, num_seats, xs, ys, NULL, &reservation_id);
   }
 
-  // Alocar um buffer para armazenar 0, o número de eventos e o array 'ids'
-  size_t buffer_size = sizeof(int) + sizeof(size_t) + num_events * sizeof(unsigned int);
-  char *buffer = (char *)malloc(buffer_size);
-  unsigned int ids[num_events];
+  epoch_exit();
+  return result;
+}
 
-  int i = 0;
+/// Builds the response to a SHOW of the given event.
+/// @note Must be called inside an epoch. No lock is held once this returns, so the response can be written
+/// at the pace of the client.
+/// @param enc Encoder to start the response in, over a newly allocated buffer (to be freed by the caller).
+/// @param event Event to be shown.
+/// @return 0 if the response was built successfully, 1 otherwise (in which case nothing needs freeing).
+static int build_show_response(struct Encoder* enc, struct Event* event) {
+  size_t num_seats = event->rows * event->cols;
+  size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + 2 * sizeof(uint64_t) + num_seats * sizeof(uint32_t);
+  char* buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for show buffer\n");
+    return 1;
+  }
 
-  to = event_list->tail;
-  current = event_list->head;
+  encode_begin(enc, buffer, buffer_size, OP_SHOW);
+  encode_i32(enc, 0);
+  encode_u64(enc, event->rows);
+  encode_u64(enc, event->cols);
+  if (snapshot_seats(encode_reserve(enc, num_seats * sizeof(uint32_t)), event, NULL) != 0) {
+    free(buffer);
+    return 1;
+  }
+  return 0;
+}
 
-  while (1) {
+int ems_show(struct Encoder* response, unsigned int event_id) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-    ids[i] = current->event->id;
+  struct Event* event = enter_event(event_id);
 
-    if (current == to) {
-      break;
-    }
-    current = current->next;
-    i++;
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
+    return 1;
   }
 
-  // Adicionar 0 ao buffer (primeiros sizeof(int) bytes)
-  int answer = 0;
-  memcpy(buffer, &answer, sizeof(int));
+  int result = build_show_response(response, event);
+  epoch_exit();
+  return result;
+}
 
-  // Adicionar o número de eventos ao buffer (primeiros sizeof(size_t) bytes)
-  memcpy(buffer + sizeof(int), &num_events, sizeof(size_t));
+int ems_availability(struct Encoder* response, unsigned int event_id) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
 
-  // Adicionar o array 'ids' ao buffer (restantes bytes)
-  memcpy(buffer + sizeof(int) + sizeof(size_t), ids, num_events * sizeof(unsigned int));
+  struct Event* event = enter_event(event_id);
 
-  //for (size_t j = 0; j < buffer_size; ++j) {
-  //      printf("Evento : %u\n", (char)buffer[j]);
-  //}
-  //
-  if (write(out_fd, buffer, buffer_size) == -1) {
-    perror("Error writing to file descriptor");
-    free(buffer);
-    pthread_rwlock_unlock(&event_list->rwl);
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
     return 1;
   }
 
-  free(buffer);
+  size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + (2 + event->rows) * sizeof(uint64_t);
+  char* buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for availability buffer\n");
+    epoch_exit();
+    return 1;
+  }
 
-  pthread_rwlock_unlock(&event_list->rwl);
-  printf("list done\n");
+  // The counters are read one by one, so under concurrent reservations the total may not match the rows exactly
+  encode_begin(response, buffer, buffer_size, OP_AVAILABILITY);
+  encode_i32(response, 0);
+  encode_u64(response, free_seats(event));
+  encode_u64(response, event->rows);
+  for (size_t row = 1; row <= event->rows; row++) {
+    encode_u64(response, row_free_seats(event, row));
+  }
+  epoch_exit();
   return 0;
 }
-int ems_signal_show(int out_fd, unsigned int event_id) {
-  if (event_list == NULL) {
+
+int ems_list_events(struct Encoder* response) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  epoch_enter();
+  struct Event** events = NULL;
+  size_t num_events = 0;
+  if (collect_events(&events, &num_events, NULL) != 0) {
+    epoch_exit();
     return 1;
   }
 
-  struct Event* event = get_event_with_delay(event_id, event_list->head, event_list->tail);
+  size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + sizeof(uint64_t) + num_events * sizeof(uint32_t);
+  char* buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for event list\n");
+    free(events);
+    epoch_exit();
+    return 1;
+  }
 
-  pthread_rwlock_unlock(&event_list->rwl);
+  // An empty registry is a successful answer with no events, which the client prints as such
+  encode_begin(response, buffer, buffer_size, OP_LIST);
+  encode_i32(response, 0);
+  encode_u64(response, num_events);
+  for (size_t i = 0; i < num_events; i++) {
+    encode_u32(response, events[i]->id);
+  }
 
-  if (event == NULL) {
-    fprintf(stderr, "Event not found\n");
+  free(events);
+  epoch_exit();
+  return 0;
+}
+
+/// Registers a report, so writers start logging what they overwrite, and collects the events it covers.
+/// @note Must be called inside an epoch, which keeps the collected events valid.
+/// @param reader Reader to register, whose version is set to that of the report.
+/// @param events Pointer to store the newly allocated array of events in. Must be freed by the caller.
+/// @param num_events Pointer to store the number of events in.
+/// @return 0 if the report was registered successfully, 1 otherwise (in which case it was not).
+static int begin_report(struct ReportReader* reader, struct Event*** events, size_t* num_events) {
+  pthread_mutex_lock(&report_mutex);
+  atomic_fetch_add(&active_reports, 1);
+  if (collect_events(events, num_events, &reader->version) != 0) {
+    atomic_fetch_sub(&active_reports, 1);
+    pthread_mutex_unlock(&report_mutex);
+    return 1;
+  }
+  reader->next = report_readers;
+  report_readers = reader;
+  pthread_mutex_unlock(&report_mutex);
+  return 0;
+}
+
+/// Unregisters a report, trimming the undo records of its events that no other report needs.
+/// @param reader Reader registered by begin_report.
+/// @param events Events covered by the report.
+/// @param num_events Number of events.
+static void end_report(struct ReportReader* reader, struct Event** events, size_t num_events) {
+  pthread_mutex_lock(&report_mutex);
+  struct ReportReader** link = &report_readers;
+  while (*link != reader) link = &(*link)->next;
+  *link = reader->next;
+  atomic_fetch_sub(&active_reports, 1);
+
+  // Writes not yet logged get a version above the current one, which no report registered later goes back to
+  unsigned long horizon = atomic_load(&report_clock);
+  for (struct ReportReader* other = report_readers; other != NULL; other = other->next) {
+    if (other->version < horizon) horizon = other->version;
+  }
+  for (size_t i = 0; i < num_events; i++) {
+    trim_undo(events[i], horizon);
+  }
+  pthread_mutex_unlock(&report_mutex);
+}
+
+int ems_report(struct Encoder* response) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  epoch_enter();
+  struct ReportReader reader;
+  struct Event** events = NULL;
+  size_t num_events = 0;
+  if (begin_report(&reader, &events, &num_events) != 0) {
+    epoch_exit();
+    return 1;
+  }
+
+  size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + sizeof(uint64_t);
+  for (size_t i = 0; i < num_events; i++) {
+    buffer_size += sizeof(uint32_t) + 2 * sizeof(uint64_t) + events[i]->rows * events[i]->cols * sizeof(uint32_t);
+  }
+  char* buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for report buffer\n");
+    end_report(&reader, events, num_events);
+    free(events);
+    epoch_exit();
     return 1;
   }
 
-  if (pthread_mutex_lock(&event->mutex) != 0) {
-    fprintf(stderr, "Error locking mutex\n");
+  encode_begin(response, buffer, buffer_size, OP_REPORT);
+  encode_i32(response, 0);
+  encode_u64(response, num_events);
+
+  // Each event is snapshot on its own, then rolled back to the report's version, so together they read as of it
+  for (size_t i = 0; i < num_events; i++) {
+    struct Event* event = events[i];
+    encode_u32(response, event->id);
+    encode_u64(response, event->rows);
+    encode_u64(response, event->cols);
+
+    char* seats = encode_reserve(response, event->rows * event->cols * sizeof(uint32_t));
+    struct SeatUndo* undo = NULL;
+    if (snapshot_seats(seats, event, &undo) != 0) {
+      end_report(&reader, events, num_events);
+      free(events);
+      epoch_exit();
+      free(buffer);
+      return 1;
+    }
+    undo_seats(seats, undo, reader.version);
+  }
+
+  end_report(&reader, events, num_events);
+  free(events);
+  epoch_exit();
+  return 0;
+}
+
+/// Prints the seats of the given event.
+/// @note The seats are printed from a snapshot, so a slow output never holds up reservations.
+/// @param out_fd File descriptor to print the event to.
+/// @param event Event to be printed.
+/// @return 0 if the event was printed successfully, 1 otherwise.
+static int print_event(int out_fd, struct Event* event) {
+  unsigned int* seats = malloc(event->rows * event->cols * sizeof(unsigned int));
+  if (seats == NULL) {
+    fprintf(stderr, "Error allocating memory for event seats\n");
+    return 1;
+  }
+  if (snapshot_seats((char*)seats, event, NULL) != 0) {
+    free(seats);
     return 1;
   }
 
   for (size_t i = 1; i <= event->rows; i++) {
     for (size_t j = 1; j <= event->cols; j++) {
       char buffer[16];
-      sprintf(buffer, "%u", event->data[seat_index(event, i, j)]);
+      sprintf(buffer, "%u", seats[seat_index(event, i, j)]);
 
       if (print_str(out_fd, buffer)) {
         perror("Error writing to file descriptor");
-        pthread_mutex_unlock(&event->mutex);
+        free(seats);
         return 1;
       }
 
       if (j < event->cols) {
         if (print_str(out_fd, " ")) {
           perror("Error writing to file descriptor");
-          pthread_mutex_unlock(&event->mutex);
+          free(seats);
           return 1;
         }
       }
@@ -389,47 +2212,116 @@ int ems_signal_show(int out_fd, unsigned int event_id) {
 
     if (print_str(out_fd, "\n")) {
       perror("Error writing to file descriptor");
-      pthread_mutex_unlock(&event->mutex);
+      free(seats);
       return 1;
     }
   }
 
-  pthread_mutex_unlock(&event->mutex);
+  free(seats);
   return 0;
 }
 
+int ems_signal_show(int out_fd, unsigned int event_id) {
+  if (event_shards == NULL) {
+    fprintf(stderr, "EMS state must be initialized\n");
+    return 1;
+  }
+
+  struct Event* event = enter_event(event_id);
+
+  if (event == NULL) {
+    fprintf(stderr, "Event not found\n");
+    epoch_exit();
+    return 1;
+  }
+
+  int result = print_event(out_fd, event);
+  epoch_exit();
+  return result;
+}
+
+
+void ems_issue_fetches(struct StateFetches* fetches, const unsigned int* event_ids, size_t count) {
+  fetches->count = count < MAX_BATCH_OPERATIONS ? count : MAX_BATCH_OPERATIONS;
+  memcpy(fetches->event_ids, event_ids, fetches->count * sizeof(unsigned int));
+
+  // Cached events answer at once, so a request on hot events only is never parked
+  bool cached = true;
+  epoch_enter();
+  for (size_t i = 0; i < fetches->count && cached; i++) cached = event_cache_contains(event_ids[i]);
+  epoch_exit();
+
+  struct StateFetch fetch;
+  issue_fetch(&fetch, 0);
+  if (cached) clock_gettime(CLOCK_MONOTONIC, &fetch.ready);
+  fetches->ready = fetch.ready;
+}
+
+void ems_complete_fetches(const struct StateFetches* fetches) {
+  num_prefetched = 0;
+  for (size_t i = 0; fetches != NULL && i < fetches->count; i++) {
+    prefetched[num_prefetched++] = (struct StateFetch){fetches->event_ids[i], fetches->ready};
+  }
+}
 
 int ems_program_status(){
-  if (event_list == NULL) {
+  if (event_shards == NULL) {
     fprintf(stderr, "EMS state must be initialized\n");
     return 1;
   }
 
-  if (pthread_rwlock_rdlock(&event_list->rwl) != 0) {
-    fprintf(stderr, "Error locking list rwl\n");
+  epoch_enter();
+  struct Event** events = NULL;
+  size_t num_events = 0;
+  if (collect_events(&events, &num_events, NULL) != 0) {
+    epoch_exit();
     return 1;
   }
 
-  struct ListNode* to = event_list->tail;
-  struct ListNode* current = event_list->head;
-
-  if (current == NULL) {
+  if (num_events == 0) {
     fprintf(stderr, "No events\n");
-    pthread_rwlock_unlock(&event_list->rwl);
+    epoch_exit();
     return 1;
   }
 
-  printf("ola\n");
-  while (1) {
-    printf("Event ID: %d\n", current->event->id);
-    ems_signal_show(STDOUT_FILENO, current->event->id);
-
-    if (current == to) {
-      break;
-    }
+  // Each event is shown through the state, whose access is waited for outside of the epoch
+  unsigned int* event_ids = malloc(num_events * sizeof(unsigned int));
+  if (event_ids == NULL) {
+    fprintf(stderr, "Error allocating memory for event ids\n");
+    free(events);
+    epoch_exit();
+    return 1;
+  }
+  for (size_t i = 0; i < num_events; i++) event_ids[i] = events[i]->id;
+  free(events);
+  epoch_exit();
 
-    current = current->next;
+  printf("ola\n");
+  for (size_t i = 0; i < num_events; i++) {
+    printf("Event ID: %d\n", event_ids[i]);
+    ems_signal_show(STDOUT_FILENO, event_ids[i]);
+  }
+  free(event_ids);
+
+  for (size_t i = 0; i < num_shards; i++) {
+    struct AllocatorStats events_stats, nodes_stats, seats_stats;
+    slab_stats(&event_shards[i]->event_slab, &events_stats);
+    slab_stats(&event_shards[i]->node_slab, &nodes_stats);
+    arena_stats(&event_shards[i]->seat_arena, &seats_stats);
+    printf("Shard %zu: events %zu/%zu B, nodes %zu/%zu B, seats %zu/%zu B in %zu chunks\n", i,
+           events_stats.bytes_in_use, events_stats.bytes_reserved, nodes_stats.bytes_in_use, nodes_stats.bytes_reserved,
+           seats_stats.bytes_in_use, seats_stats.bytes_reserved, seats_stats.chunks);
   }
 
+  struct AllocatorStats lists_stats;
+  thread_slab_stats(&seat_lists, &lists_stats);
+  printf("Seat lists: %zu/%zu B in %zu chunks\n", lists_stats.bytes_in_use, lists_stats.bytes_reserved,
+         lists_stats.chunks);
+
+  struct EventCacheStats cache_stats;
+  event_cache_stats(&cache_stats);
+  unsigned long lookups = cache_stats.hits + cache_stats.misses;
+  printf("Event cache: %zu events, %lu hits, %lu misses (%.1f%% hit rate)\n", cache_stats.capacity, cache_stats.hits,
+         cache_stats.misses, lookups == 0 ? 0.0 : 100.0 * (double)cache_stats.hits / (double)lookups);
   return 0;
-}
\ No newline at end of file
+}
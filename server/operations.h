@@ -2,11 +2,30 @@
 #define SERVER_OPERATIONS_H
 
 #include <stddef.h>
+#include <time.h>
+
+#include "common/codec.h"
+
+// State accesses issued for an operation ahead of running it
+struct StateFetches {
+  unsigned int event_ids[MAX_BATCH_OPERATIONS];
+  size_t count;
+  struct timespec ready;  // Moment every access has answered (CLOCK_MONOTONIC)
+};
+
+// How reservations claim their seats
+enum ReserveEngine {
+  RESERVE_LOCKED,    // Lock the row stripes touched by the reservation
+  RESERVE_LOCK_FREE  // Claim each seat with a compare-and-swap, rolling back on conflict
+};
 
 /// Initializes the EMS state.
 /// @param delay_us Delay in microseconds.
+/// @param shard_count Number of shards the event registry is split in, each with its own lock.
+/// @param engine How reservations claim their seats.
+/// @param cache_capacity Number of hot events served from a cache without the delay (0 disables the cache).
 /// @return 0 if the EMS state was initialized successfully, 1 otherwise.
-int ems_init(unsigned int delay_us);
+int ems_init(unsigned int delay_us, size_t shard_count, enum ReserveEngine engine, size_t cache_capacity);
 
 /// Destroys the EMS state.
 int ems_terminate();
@@ -18,6 +37,12 @@ int ems_terminate();
 /// @return 0 if the event was created successfully, 1 otherwise.
 int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 
+/// Deletes the event with the given id, releasing its seats.
+/// @note Workers still serving a request on the event finish it before the memory is reclaimed.
+/// @param event_id Id of the event to be deleted.
+/// @return 0 if the event was deleted successfully, 1 otherwise.
+int ems_delete(unsigned int event_id);
+
 /// Creates a new reservation for the given event.
 /// @param event_id Id of the event to create a reservation for.
 /// @param num_seats Number of seats to reserve.
@@ -26,16 +51,88 @@ int ems_create(unsigned int event_id, size_t num_rows, size_t num_cols);
 /// @return 0 if the reservation was created successfully, 1 otherwise.
 int ems_reserve(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
 
-/// Prints the given event.
-/// @param out_fd File descriptor to print the event to.
-/// @param event_id Id of the event to print.
-/// @return 0 if the event was printed successfully, 1 otherwise.
-int ems_show(int out_fd, unsigned int event_id);
+/// Reserves the best available seats of the given event: the first run of adjacent free seats, front rows
+/// first, or failing that the free seats spread over the fewest consecutive rows.
+/// @param event_id Id of the event to create a reservation for.
+/// @param num_seats Number of seats to reserve (at most MAX_RESERVATION_SIZE).
+/// @param xs Array to store the rows of the reserved seats in.
+/// @param ys Array to store the columns of the reserved seats in.
+/// @return 0 if the reservation was created successfully, 1 otherwise.
+int ems_reserve_best(unsigned int event_id, size_t num_seats, size_t *xs, size_t *ys);
+
+/// Creates a reservation on each of several events, all or nothing.
+/// @param num_groups Number of events (at most MAX_TRANSACTION_EVENTS, each appearing once).
+/// @param event_ids Array of ids of the events.
+/// @param num_seats Array of the number of seats to reserve on each event.
+/// @param xs Array of rows of the seats to reserve, the seats of each event following the previous event's.
+/// @param ys Array of columns of the seats to reserve, in the same order as xs.
+/// @return 0 if every reservation was created, 1 otherwise (in which case none was).
+int ems_reserve_transaction(size_t num_groups, unsigned int *event_ids, size_t *num_seats, size_t *xs, size_t *ys);
+
+/// Cancels a reservation, freeing its seats.
+/// @param event_id Id of the event the reservation belongs to.
+/// @param reservation_id Id of the reservation to be cancelled.
+/// @return 0 if the reservation was cancelled successfully, 1 otherwise.
+int ems_cancel(unsigned int event_id, unsigned int reservation_id);
+
+/// Holds seats of the given event for a limited time, after which they are freed unless confirmed.
+/// @note A hold is a reservation like any other until it expires: its seats show its id, and it can be cancelled.
+/// @param event_id Id of the event to hold the seats of.
+/// @param ttl_ms Time the seats are held for, in milliseconds.
+/// @param num_seats Number of seats to hold.
+/// @param xs Array of rows of the seats to hold.
+/// @param ys Array of columns of the seats to hold.
+/// @param hold_id Pointer to store the id of the hold in (the id of its reservation).
+/// @return 0 if the seats were held successfully, 1 otherwise.
+int ems_hold(unsigned int event_id, unsigned int ttl_ms, size_t num_seats, size_t *xs, size_t *ys,
+             unsigned int *hold_id);
+
+/// Turns a hold into a reservation that no longer expires.
+/// @param event_id Id of the event the hold belongs to.
+/// @param hold_id Id of the hold to be confirmed.
+/// @return 0 if the hold was confirmed successfully, 1 otherwise (including when it already expired).
+int ems_confirm(unsigned int event_id, unsigned int hold_id);
+
+/// Builds the response to a SHOW of the given event.
+/// @note Responses are built rather than written, so the caller decides when and where they go.
+/// @param response Encoder to start the response in, over a newly allocated buffer (response->data) that the
+/// caller must free if 0 is returned.
+/// @param event_id Id of the event to show.
+/// @return 0 if the response was built successfully, 1 otherwise (in which case nothing was allocated).
+int ems_show(struct Encoder *response, unsigned int event_id);
+
+/// Builds the response with the number of free seats of the given event, in total and per row, without
+/// reading its seats.
+/// @param response Encoder to start the response in, like for ems_show.
+/// @param event_id Id of the event.
+/// @return 0 if the response was built successfully, 1 otherwise.
+int ems_availability(struct Encoder *response, unsigned int event_id);
+
+/// Builds the response with the ids of all the events.
+/// @param response Encoder to start the response in, like for ems_show.
+/// @return 0 if the response was built successfully, 1 otherwise.
+int ems_list_events(struct Encoder *response);
+
+/// Builds the response with every event and its seats, all as of a single moment, without blocking reservations.
+/// @note Events created or deleted during the report do not change it either.
+/// @param response Encoder to start the response in, like for ems_show.
+/// @return 0 if the response was built successfully, 1 otherwise.
+int ems_report(struct Encoder *response);
+
+/// Issues the state accesses of an upcoming operation without waiting for them, so the calling thread can go
+/// on with other work until they answer.
+/// @note Accesses to events in the event cache answer at once.
+/// @param fetches Accesses to be issued.
+/// @param event_ids Array of ids of the events, in the order the operation will use them.
+/// @param count Number of events (only the first MAX_BATCH_OPERATIONS are issued).
+void ems_issue_fetches(struct StateFetches *fetches, const unsigned int *event_ids, size_t count);
 
-/// Prints all the events.
-/// @param out_fd File descriptor to print the events to.
-/// @return 0 if the events were printed successfully, 1 otherwise.
-int ems_list_events(int out_fd);
+/// Hands issued state accesses to the next operations of the calling thread.
+/// @note The next operation of the thread on each event takes its access instead of issuing one, and only
+/// waits for whatever is left of its delay. Accesses left from a previous call are dropped, so NULL just
+/// drops them.
+/// @param fetches Accesses issued with ems_issue_fetches (may be NULL).
+void ems_complete_fetches(const struct StateFetches *fetches);
 
 int ems_program_status();
 
@@ -0,0 +1,551 @@
+#include "session.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "common/codec.h"
+#include "common/constants.h"
+#include "operations.h"
+
+// Connection of a client, whose requests may be executed several at a time
+struct Session {
+  struct Channel requests;
+  struct Channel responses;
+  pthread_mutex_t lock;  // Serializes the responses written to the channel and protects in_flight
+  pthread_cond_t idle;   // Signaled whenever a request of the session is answered
+  size_t in_flight;      // Requests read and not yet answered
+};
+
+// Request waiting for an executor
+struct Request {
+  struct Session *session;
+  struct FrameHeader header;
+  void *payload;
+  struct StateFetches fetches;  // State accesses of the request, issued as soon as it is read
+  struct Request *next;
+};
+
+// Room for the responses built without allocating: a status, or the status and hold id of a HOLD
+#define SMALL_RESPONSE_SIZE (FRAME_HEADER_SIZE + sizeof(int32_t) + sizeof(uint32_t))
+
+// The state accesses of a request are issued as soon as it is read. A request whose accesses answer at once
+// waits in the queue for an executor; any other is parked among the waiting requests until they answer, without
+// taking an executor. However few the executors are, every request in flight thus has its accesses outstanding.
+static struct Request *queue_head = NULL;
+static struct Request *queue_tail = NULL;
+static struct Request *waiting = NULL;  // Requests whose state accesses are outstanding, soonest to answer first
+static pthread_mutex_t queue_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond;  // Signaled when a request is queued or parked (waits on CLOCK_MONOTONIC)
+
+/// Builds a response made of the status alone.
+/// @param response Encoder to start the response in.
+/// @param small_buffer Buffer of SMALL_RESPONSE_SIZE bytes the response is built in.
+/// @param opcode Opcode of the request being answered.
+/// @param status Status of the response.
+static void build_status(struct Encoder *response, unsigned char *small_buffer, uint8_t opcode, int status) {
+  encode_begin(response, small_buffer, SMALL_RESPONSE_SIZE, opcode);
+  encode_i32(response, status);
+}
+
+/// Frees a response once written.
+/// @param response Encoder holding the response.
+/// @param small_buffer Buffer given to run_operation along with the response.
+static void release_response(struct Encoder *response, unsigned char *small_buffer) {
+  if (response->data != small_buffer) free(response->data);
+}
+
+/// Takes a list of seats from a request: their number, then the row and column of each one.
+/// @param dec Decoder to take the seats from.
+/// @param capacity Number of seats xs and ys can hold.
+/// @param num_seats Pointer to store the number of seats in.
+/// @param xs Array to store the rows of the seats in.
+/// @param ys Array to store the columns of the seats in.
+/// @return 0 if the seats were decoded, 1 otherwise (including when there are more than capacity).
+static int decode_seats(struct Decoder *dec, size_t capacity, size_t *num_seats, size_t *xs, size_t *ys) {
+  uint64_t count;
+  if (decode_u64(dec, &count) != 0 || count > capacity) return 1;
+
+  for (size_t i = 0; i < count; i++) {
+    uint64_t row, col;
+    if (decode_u64(dec, &row) != 0 || decode_u64(dec, &col) != 0) return 1;
+    xs[i] = row;
+    ys[i] = col;
+  }
+  *num_seats = count;
+  return 0;
+}
+
+/// Runs an operation and builds its response.
+/// @param opcode Opcode of the operation.
+/// @param dec Decoder over the payload of the request.
+/// @param response Encoder to start the response in, over either small_buffer or a newly allocated buffer; must
+/// be released with release_response.
+/// @param small_buffer Buffer of SMALL_RESPONSE_SIZE bytes for responses that fit in it.
+static void run_operation(uint8_t opcode, struct Decoder *dec, struct Encoder *response, unsigned char *small_buffer) {
+  switch (opcode) {
+    case OP_CREATE: {
+      uint32_t event_id;
+      uint64_t num_rows, num_cols;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_u64(dec, &num_rows) == 0 && decode_u64(dec, &num_cols) == 0) {
+        answer = ems_create(event_id, num_rows, num_cols);
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_RESERVE: {
+      uint32_t event_id;
+      size_t num_seats = 0, xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_seats(dec, MAX_RESERVATION_SIZE, &num_seats, xs, ys) == 0) {
+        answer = ems_reserve(event_id, num_seats, xs, ys);
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_SHOW: {
+      uint32_t event_id;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0) {
+        answer = ems_show(response, event_id);
+      }
+      if (answer != 0) build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_LIST:
+      if (ems_list_events(response) != 0) build_status(response, small_buffer, opcode, 1);
+      break;
+
+    case OP_DELETE: {
+      uint32_t event_id;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0) {
+        answer = ems_delete(event_id);
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_BEST: {
+      // The answer is followed by the number of seats and the row and column of each one
+      uint32_t event_id;
+      uint64_t num_seats = 0;
+      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_u64(dec, &num_seats) == 0) {
+        answer = ems_reserve_best(event_id, num_seats, xs, ys);
+      }
+
+      size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + (1 + 2 * num_seats) * sizeof(uint64_t);
+      unsigned char *buffer = answer == 0 ? malloc(buffer_size) : NULL;
+      if (buffer == NULL) {
+        if (answer == 0) fprintf(stderr, "Error allocating memory for best seats response\n");
+        build_status(response, small_buffer, opcode, 1);
+        break;
+      }
+
+      encode_begin(response, buffer, buffer_size, opcode);
+      encode_i32(response, 0);
+      encode_u64(response, num_seats);
+      for (size_t i = 0; i < num_seats; i++) {
+        encode_u64(response, xs[i]);
+        encode_u64(response, ys[i]);
+      }
+      break;
+    }
+
+    case OP_TRANSACTION: {
+      uint64_t num_groups = 0;
+      unsigned int event_ids[MAX_TRANSACTION_EVENTS];
+      size_t num_seats[MAX_TRANSACTION_EVENTS];
+      size_t xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      size_t total_seats = 0;
+      int answer = decode_u64(dec, &num_groups) != 0 || num_groups > MAX_TRANSACTION_EVENTS;
+      for (size_t g = 0; answer == 0 && g < num_groups; g++) {
+        answer = decode_u32(dec, &event_ids[g]) != 0 ||
+                 decode_seats(dec, MAX_RESERVATION_SIZE - total_seats, &num_seats[g], xs + total_seats,
+                              ys + total_seats) != 0;
+        if (answer == 0) total_seats += num_seats[g];
+      }
+      if (answer == 0) {
+        answer = ems_reserve_transaction(num_groups, event_ids, num_seats, xs, ys);
+      } else {
+        printf("Error parsing command\n");
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_CANCEL: {
+      uint32_t event_id, reservation_id;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_u32(dec, &reservation_id) == 0) {
+        answer = ems_cancel(event_id, reservation_id);
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_HOLD: {
+      uint32_t event_id, ttl_ms;
+      unsigned int hold_id = 0;
+      size_t num_seats = 0, xs[MAX_RESERVATION_SIZE], ys[MAX_RESERVATION_SIZE];
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_u32(dec, &ttl_ms) == 0 &&
+          decode_seats(dec, MAX_RESERVATION_SIZE, &num_seats, xs, ys) == 0) {
+        answer = ems_hold(event_id, ttl_ms, num_seats, xs, ys, &hold_id);
+      } else {
+        printf("Error parsing command\n");
+      }
+
+      // The hold id only follows a successful answer
+      build_status(response, small_buffer, opcode, answer);
+      if (answer == 0) encode_u32(response, hold_id);
+      break;
+    }
+
+    case OP_CONFIRM: {
+      uint32_t event_id, hold_id;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0 && decode_u32(dec, &hold_id) == 0) {
+        answer = ems_confirm(event_id, hold_id);
+      }
+      build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    case OP_REPORT:
+      if (ems_report(response) != 0) build_status(response, small_buffer, opcode, 1);
+      break;
+
+    case OP_AVAILABILITY: {
+      uint32_t event_id;
+      int answer = 1;
+      if (decode_u32(dec, &event_id) == 0) {
+        answer = ems_availability(response, event_id);
+      }
+      if (answer != 0) build_status(response, small_buffer, opcode, answer);
+      break;
+    }
+
+    default:
+      // Every request gets an answer, so the client never waits on one that will not come (nor do batches nest)
+      build_status(response, small_buffer, opcode, 1);
+      break;
+  }
+}
+
+/// Gets the events whose state a request accesses.
+/// @param header Header of the request.
+/// @param payload Payload of the request.
+/// @param event_ids Array to append the ids of the events to.
+/// @param capacity Number of ids event_ids has room for; events beyond it are left out.
+/// @return Number of ids appended (none for a malformed request, which accesses no state).
+static size_t events_of(const struct FrameHeader *header, const void *payload, unsigned int *event_ids,
+                        size_t capacity) {
+  struct Decoder dec;
+  decode_begin(&dec, payload, header->size);
+  size_t count = 0;
+  switch (header->opcode) {
+    case OP_CREATE:
+    case OP_RESERVE:
+    case OP_SHOW:
+    case OP_DELETE:
+    case OP_BEST:
+    case OP_CANCEL:
+    case OP_HOLD:
+    case OP_CONFIRM:
+    case OP_AVAILABILITY: {
+      // The event id is the first field of each of them
+      uint32_t id;
+      if (capacity > 0 && decode_u32(&dec, &id) == 0) event_ids[count++] = id;
+      return count;
+    }
+
+    case OP_TRANSACTION: {
+      uint64_t num_groups, num_seats, coordinate;
+      if (decode_u64(&dec, &num_groups) != 0 || num_groups > MAX_TRANSACTION_EVENTS) return 0;
+      for (size_t g = 0; g < num_groups; g++) {
+        uint32_t id;
+        if (decode_u32(&dec, &id) != 0 || decode_u64(&dec, &num_seats) != 0 || num_seats > MAX_RESERVATION_SIZE) {
+          return 0;
+        }
+        for (size_t i = 0; i < 2 * num_seats; i++) {
+          if (decode_u64(&dec, &coordinate) != 0) return 0;
+        }
+        if (count < capacity) event_ids[count++] = id;
+      }
+      return count;
+    }
+
+    case OP_BATCH: {
+      uint64_t num_operations;
+      if (decode_u64(&dec, &num_operations) != 0 || num_operations > MAX_BATCH_OPERATIONS) return 0;
+      for (size_t i = 0; i < num_operations; i++) {
+        struct FrameHeader operation;
+        const void *operation_payload;
+        if (decode_frame(&dec, &operation, &operation_payload) != 0) return 0;
+        // Batches do not nest, so an operation's own events are never a batch's
+        if (operation.opcode != OP_BATCH) {
+          count += events_of(&operation, operation_payload, event_ids + count, capacity - count);
+        }
+      }
+      return count;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+/// Runs the operations of a batch one after the other and builds a response with all their responses.
+/// @note The operations only run once the whole batch has been decoded, so a malformed batch runs none.
+/// @param dec Decoder over the payload of the batch.
+/// @param response Encoder to start the response in, like for run_operation.
+/// @param small_buffer Buffer of SMALL_RESPONSE_SIZE bytes, like for run_operation.
+static void run_batch(struct Decoder *dec, struct Encoder *response, unsigned char *small_buffer) {
+  uint64_t count;
+  struct FrameHeader headers[MAX_BATCH_OPERATIONS];
+  const void *payloads[MAX_BATCH_OPERATIONS];
+  int valid = decode_u64(dec, &count) == 0 && count <= MAX_BATCH_OPERATIONS;
+  for (size_t i = 0; valid && i < count; i++) {
+    valid = decode_frame(dec, &headers[i], &payloads[i]) == 0;
+  }
+  if (!valid) {
+    printf("Error parsing command\n");
+    build_status(response, small_buffer, OP_BATCH, 1);
+    return;
+  }
+
+  struct Encoder responses[MAX_BATCH_OPERATIONS];
+  unsigned char small_buffers[MAX_BATCH_OPERATIONS][SMALL_RESPONSE_SIZE];
+  size_t buffer_size = FRAME_HEADER_SIZE + sizeof(int32_t) + sizeof(uint64_t);
+  for (size_t i = 0; i < count; i++) {
+    struct Decoder operation;
+    decode_begin(&operation, payloads[i], headers[i].size);
+    run_operation(headers[i].opcode, &operation, &responses[i], small_buffers[i]);
+    buffer_size += responses[i].size;
+  }
+
+  unsigned char *buffer = malloc(buffer_size);
+  if (buffer == NULL) {
+    fprintf(stderr, "Error allocating memory for batch response\n");
+    build_status(response, small_buffer, OP_BATCH, 1);
+  } else {
+    encode_begin(response, buffer, buffer_size, OP_BATCH);
+    encode_i32(response, 0);
+    encode_u64(response, count);
+    for (size_t i = 0; i < count; i++) {
+      encode_frame(response, &responses[i], headers[i].tag);
+    }
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    release_response(&responses[i], small_buffers[i]);
+  }
+}
+
+/// Checks whether a moment comes before another.
+static bool earlier(const struct timespec *a, const struct timespec *b) {
+  return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/// Issues the state accesses of a request, without waiting for them.
+/// @param request Request whose accesses are issued.
+/// @return Whether the accesses already answered.
+static bool issue_request(struct Request *request) {
+  unsigned int event_ids[MAX_BATCH_OPERATIONS];
+  size_t count = events_of(&request->header, request->payload, event_ids, MAX_BATCH_OPERATIONS);
+  ems_issue_fetches(&request->fetches, event_ids, count);
+
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return !earlier(&now, &request->fetches.ready);
+}
+
+/// Executes a request whose state accesses were issued, and answers it.
+/// @note Whatever is left of the delay of the accesses is waited for by the operations.
+/// @param request Request to execute.
+static void execute(struct Request *request) {
+  struct Session *session = request->session;
+  struct Decoder dec;
+  decode_begin(&dec, request->payload, request->header.size);
+
+  struct Encoder response;
+  unsigned char small_buffer[SMALL_RESPONSE_SIZE];
+  ems_complete_fetches(&request->fetches);
+  if (request->header.opcode == OP_BATCH) {
+    run_batch(&dec, &response, small_buffer);
+  } else {
+    run_operation(request->header.opcode, &dec, &response, small_buffer);
+  }
+  ems_complete_fetches(NULL);
+
+  pthread_mutex_lock(&session->lock);
+  if (send_frame(&session->responses, &response, request->header.tag) != 0) perror("Error writing response");
+  pthread_mutex_unlock(&session->lock);
+  release_response(&response, small_buffer);
+}
+
+/// Queues a request whose state accesses answered, for the next free executor.
+/// @param request Request to be queued.
+static void enqueue(struct Request *request) {
+  pthread_mutex_lock(&queue_mutex);
+  if (queue_tail == NULL) {
+    queue_head = request;
+  } else {
+    queue_tail->next = request;
+  }
+  queue_tail = request;
+  pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+}
+
+/// Parks a request until its state accesses answer.
+/// @param request Request whose accesses were issued.
+static void park(struct Request *request) {
+  pthread_mutex_lock(&queue_mutex);
+  struct Request **link = &waiting;
+  while (*link != NULL && !earlier(&request->fetches.ready, &(*link)->fetches.ready)) link = &(*link)->next;
+  request->next = *link;
+  *link = request;
+  // An executor sleeping until a later moment, or with nothing to wait for, must look again
+  if (waiting == request) pthread_cond_signal(&queue_cond);
+  pthread_mutex_unlock(&queue_mutex);
+}
+
+/// Takes the next request to work on, waiting for one if there is none.
+/// @note Parked requests whose accesses answered go before new requests, so they are not held back by them.
+/// @return Request whose accesses answered.
+static struct Request *next_request(void) {
+  pthread_mutex_lock(&queue_mutex);
+  struct Request *request = NULL;
+  while (request == NULL) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (waiting != NULL && !earlier(&now, &waiting->fetches.ready)) {
+      request = waiting;
+      waiting = request->next;
+    } else if (queue_head != NULL) {
+      request = queue_head;
+      queue_head = request->next;
+      if (queue_head == NULL) queue_tail = NULL;
+    } else if (waiting != NULL) {
+      pthread_cond_timedwait(&queue_cond, &queue_mutex, &waiting->fetches.ready);
+    } else {
+      pthread_cond_wait(&queue_cond, &queue_mutex);
+    }
+  }
+  pthread_mutex_unlock(&queue_mutex);
+  return request;
+}
+
+static void *executor_loop(void *arg) {
+  (void)arg;
+  sigset_t set;
+  sigemptyset(&set);
+  sigaddset(&set, SIGUSR1);
+  pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+  while (1) {
+    struct Request *request = next_request();
+    struct Session *session = request->session;
+    execute(request);
+    free(request->payload);
+    free(request);
+
+    pthread_mutex_lock(&session->lock);
+    session->in_flight--;
+    pthread_cond_broadcast(&session->idle);
+    pthread_mutex_unlock(&session->lock);
+  }
+  return NULL;
+}
+
+int executors_start(size_t count) {
+  // Parked requests are resumed at moments on the clock of the state accesses
+  pthread_condattr_t attr;
+  if (pthread_condattr_init(&attr) != 0 || pthread_condattr_setclock(&attr, CLOCK_MONOTONIC) != 0 ||
+      pthread_cond_init(&queue_cond, &attr) != 0) {
+    fprintf(stderr, "Error initializing executor queue\n");
+    return 1;
+  }
+  pthread_condattr_destroy(&attr);
+
+  for (size_t i = 0; i < count; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, executor_loop, NULL) != 0) {
+      fprintf(stderr, "Error creating executor thread\n");
+      return 1;
+    }
+    pthread_detach(thread);
+  }
+  return 0;
+}
+
+void serve_session(const struct Channel *requests, const struct Channel *responses) {
+  struct Session session = {.requests = *requests, .responses = *responses, .in_flight = 0};
+  pthread_mutex_init(&session.lock, NULL);
+  pthread_cond_init(&session.idle, NULL);
+
+  while (1) {
+    struct Request *request = malloc(sizeof(struct Request));
+    if (request == NULL) {
+      fprintf(stderr, "Error allocating memory for request\n");
+      break;
+    }
+    if (read_frame_alloc(&session.requests, &request->header, &request->payload, MAX_BATCH_PAYLOAD) != 0) {
+      free(request);
+      break;
+    }
+    if (request->header.opcode == OP_QUIT) {
+      free(request->payload);
+      free(request);
+      break;
+    }
+    request->session = &session;
+    request->next = NULL;
+
+    // A client keeps at most MAX_REQUESTS_IN_FLIGHT requests unanswered; one sending more waits here, and so
+    // cannot take every executor. Only this thread adds requests in flight, so the count cannot grow meanwhile.
+    pthread_mutex_lock(&session.lock);
+    while (session.in_flight >= MAX_REQUESTS_IN_FLIGHT) pthread_cond_wait(&session.idle, &session.lock);
+    pthread_mutex_unlock(&session.lock);
+
+    // A request whose accesses answered at once, with nothing else of the session in flight nor waiting to be
+    // read, runs right here: handing it to an executor would only add a wake-up to the round trip of a client
+    // waiting on it. One whose accesses are outstanding goes on, so the session reads on meanwhile.
+    bool answered = issue_request(request);
+    bool more_waiting = channel_has_data(&session.requests);
+    pthread_mutex_lock(&session.lock);
+    bool alone = answered && session.in_flight == 0 && !more_waiting;
+    if (!alone) session.in_flight++;
+    pthread_mutex_unlock(&session.lock);
+
+    if (alone) {
+      execute(request);
+      free(request->payload);
+      free(request);
+    } else if (answered) {
+      enqueue(request);
+    } else {
+      park(request);
+    }
+  }
+
+  // The executors still answering the session reference it, and write to its pipe
+  pthread_mutex_lock(&session.lock);
+  while (session.in_flight > 0) pthread_cond_wait(&session.idle, &session.lock);
+  pthread_mutex_unlock(&session.lock);
+
+  pthread_cond_destroy(&session.idle);
+  pthread_mutex_destroy(&session.lock);
+}
@@ -0,0 +1,23 @@
+#ifndef SERVER_SESSION_H
+#define SERVER_SESSION_H
+
+#include <stddef.h>
+
+#include "common/codec.h"
+
+/// Starts the threads executing the requests of every session.
+/// @note A request waiting for the state does not occupy a thread, so many more requests than threads can be
+/// in progress at once.
+/// @param count Number of threads, and so of requests running at once across all sessions.
+/// @return 0 if the threads were started successfully, 1 otherwise.
+int executors_start(size_t count);
+
+/// Serves the requests of a client until it quits or closes its request pipe.
+/// @note Requests are read in order but executed concurrently by the executors, and each is answered as soon
+/// as it completes, tagged so the client can match it. The client orders requests that depend on each other.
+/// Returns once every request read has been answered.
+/// @param requests Channel the requests are read from.
+/// @param responses Channel the responses are written to.
+void serve_session(const struct Channel *requests, const struct Channel *responses);
+
+#endif  // SERVER_SESSION_H
@@ -0,0 +1,233 @@
+#include "timerwheel.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <time.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)  // Slots per level
+#define WHEEL_LEVELS 4                 // Each slot of a level spans a whole turn of the level below
+#define WHEEL_SPAN (((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1)  // Longest delay, in ticks
+
+enum TimerState { TIMER_IDLE, TIMER_PENDING, TIMER_FIRING };
+
+// Each slot is a circular list headed by a sentinel, so a timer unlinks itself without knowing its slot
+static struct TimerEntry slots[WHEEL_LEVELS][WHEEL_SLOTS];
+static uint64_t current_tick = 0;  // Last tick processed
+static size_t pending = 0;         // Number of timers in the wheel
+
+static unsigned int tick_length_ms = 0;
+static struct timespec start_time;
+static bool running = false;
+static pthread_t wheel_thread;
+static pthread_mutex_t wheel_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t wheel_cond;
+
+/// Gets the number of whole ticks elapsed since the wheel started.
+static uint64_t elapsed_ticks(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  int64_t elapsed_ms = (int64_t)(now.tv_sec - start_time.tv_sec) * 1000 + (now.tv_nsec - start_time.tv_nsec) / 1000000;
+  return (uint64_t)elapsed_ms / tick_length_ms;
+}
+
+/// Gets the moment the given tick starts at.
+static struct timespec tick_deadline(uint64_t tick) {
+  uint64_t ms = tick * tick_length_ms;
+  struct timespec deadline = start_time;
+  deadline.tv_sec += (time_t)(ms / 1000);
+  deadline.tv_nsec += (long)(ms % 1000) * 1000000;
+  if (deadline.tv_nsec >= 1000000000) {
+    deadline.tv_sec++;
+    deadline.tv_nsec -= 1000000000;
+  }
+  return deadline;
+}
+
+static void unlink_entry(struct TimerEntry *entry) {
+  entry->prev->next = entry->next;
+  entry->next->prev = entry->prev;
+}
+
+/// Puts a timer in the slot matching its distance from the current tick.
+/// @note Must be called with the wheel's mutex held.
+static void place(struct TimerEntry *entry) {
+  uint64_t delta = entry->expires - current_tick;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 && delta >= ((uint64_t)1 << (WHEEL_BITS * (level + 1)))) {
+    level++;
+  }
+
+  struct TimerEntry *head = &slots[level][(entry->expires >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+  entry->prev = head->prev;
+  entry->next = head;
+  head->prev->next = entry;
+  head->prev = entry;
+}
+
+/// Moves the timers of a slot to the levels below, now that the slot's turn has come.
+/// @note Must be called with the wheel's mutex held.
+static void cascade(int level) {
+  struct TimerEntry *head = &slots[level][(current_tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1)];
+  struct TimerEntry *entry = head->next;
+  head->prev = head->next = head;
+
+  while (entry != head) {
+    struct TimerEntry *next = entry->next;
+    place(entry);
+    entry = next;
+  }
+}
+
+/// Advances the wheel by one tick, firing the timers that expire on it.
+/// @note Must be called with the wheel's mutex held, which is released while the timers fire.
+static void advance(void) {
+  current_tick++;
+
+  // Higher levels go first, so timers they hand down are cascaded again in the same tick if needed
+  int top = 0;
+  while (top < WHEEL_LEVELS - 1 && (current_tick & (((uint64_t)1 << (WHEEL_BITS * (top + 1))) - 1)) == 0) {
+    top++;
+  }
+  for (int level = top; level > 0; level--) {
+    cascade(level);
+  }
+
+  struct TimerEntry *head = &slots[0][current_tick & (WHEEL_SLOTS - 1)];
+  if (head->next == head) return;
+
+  // Detach the whole slot, so the timers fire without the lock and may be freed by their callbacks
+  struct TimerEntry *first = head->next;
+  head->prev->next = NULL;
+  head->prev = head->next = head;
+  for (struct TimerEntry *entry = first; entry != NULL; entry = entry->next) {
+    entry->state = TIMER_FIRING;
+    pending--;
+  }
+
+  pthread_mutex_unlock(&wheel_mutex);
+  while (first != NULL) {
+    struct TimerEntry *next = first->next;
+    first->fire(first);
+    first = next;
+  }
+  pthread_mutex_lock(&wheel_mutex);
+}
+
+static void *wheel_loop(void *arg) {
+  (void)arg;
+
+  pthread_mutex_lock(&wheel_mutex);
+  while (running) {
+    // Nothing to expire, so sleep until a timer is scheduled rather than ticking
+    if (pending == 0) {
+      pthread_cond_wait(&wheel_cond, &wheel_mutex);
+      continue;
+    }
+
+    struct timespec deadline = tick_deadline(current_tick + 1);
+    int result = pthread_cond_timedwait(&wheel_cond, &wheel_mutex, &deadline);
+    if (result != 0 && result != ETIMEDOUT) {
+      fprintf(stderr, "Error waiting for the next tick\n");
+    }
+
+    for (uint64_t target = elapsed_ticks(); running && current_tick < target;) {
+      advance();
+    }
+  }
+  pthread_mutex_unlock(&wheel_mutex);
+  return NULL;
+}
+
+int timer_wheel_start(unsigned int tick_ms) {
+  if (running || tick_ms == 0) return 1;
+
+  pthread_condattr_t attr;
+  if (pthread_condattr_init(&attr) != 0) return 1;
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  int result = pthread_cond_init(&wheel_cond, &attr);
+  pthread_condattr_destroy(&attr);
+  if (result != 0) return 1;
+
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+      slots[level][slot].prev = slots[level][slot].next = &slots[level][slot];
+    }
+  }
+  tick_length_ms = tick_ms;
+  clock_gettime(CLOCK_MONOTONIC, &start_time);
+  current_tick = 0;
+  pending = 0;
+  running = true;
+
+  if (pthread_create(&wheel_thread, NULL, wheel_loop, NULL) != 0) {
+    running = false;
+    pthread_cond_destroy(&wheel_cond);
+    return 1;
+  }
+  return 0;
+}
+
+void timer_wheel_stop(void (*discard)(struct TimerEntry *)) {
+  pthread_mutex_lock(&wheel_mutex);
+  if (!running) {
+    pthread_mutex_unlock(&wheel_mutex);
+    return;
+  }
+  running = false;
+  pthread_cond_signal(&wheel_cond);
+  pthread_mutex_unlock(&wheel_mutex);
+  pthread_join(wheel_thread, NULL);
+
+  for (int level = 0; level < WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < WHEEL_SLOTS; slot++) {
+      struct TimerEntry *head = &slots[level][slot];
+      struct TimerEntry *entry = head->next;
+      head->prev = head->next = head;
+      while (entry != head) {
+        struct TimerEntry *next = entry->next;
+        entry->state = TIMER_IDLE;
+        if (discard != NULL) discard(entry);
+        entry = next;
+      }
+    }
+  }
+  pending = 0;
+  pthread_cond_destroy(&wheel_cond);
+}
+
+void timer_schedule(struct TimerEntry *entry, unsigned int delay_ms, void (*fire)(struct TimerEntry *)) {
+  pthread_mutex_lock(&wheel_mutex);
+
+  // An empty wheel may have stopped ticking, so it catches up first (there is nothing to expire on the way)
+  uint64_t now = elapsed_ticks();
+  if (pending == 0 && now > current_tick) current_tick = now;
+
+  uint64_t delay = (delay_ms + tick_length_ms - 1) / tick_length_ms;
+  if (delay == 0) delay = 1;
+  entry->expires = (now > current_tick ? now : current_tick) + delay;
+  if (entry->expires - current_tick > WHEEL_SPAN) entry->expires = current_tick + WHEEL_SPAN;
+
+  entry->fire = fire;
+  entry->state = TIMER_PENDING;
+  place(entry);
+  if (pending++ == 0) pthread_cond_signal(&wheel_cond);
+
+  pthread_mutex_unlock(&wheel_mutex);
+}
+
+int timer_cancel(struct TimerEntry *entry) {
+  pthread_mutex_lock(&wheel_mutex);
+  if (entry->state != TIMER_PENDING) {
+    pthread_mutex_unlock(&wheel_mutex);
+    return 1;
+  }
+
+  unlink_entry(entry);
+  entry->state = TIMER_IDLE;
+  pending--;
+  pthread_mutex_unlock(&wheel_mutex);
+  return 0;
+}
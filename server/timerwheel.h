@@ -0,0 +1,38 @@
+#ifndef SERVER_TIMER_WHEEL_H
+#define SERVER_TIMER_WHEEL_H
+
+#include <stdint.h>
+
+// Timer kept in the wheel. Embedded in the object it times, so scheduling never allocates.
+// A zeroed entry is idle.
+struct TimerEntry {
+  uint64_t expires;                         // Tick at which the timer fires
+  int state;                                // Whether the timer is idle, pending or firing
+  void (*fire)(struct TimerEntry *);        // Called from the wheel thread when the timer expires
+  struct TimerEntry *prev;
+  struct TimerEntry *next;
+};
+
+/// Starts the wheel thread.
+/// @param tick_ms Resolution of the wheel, in milliseconds.
+/// @return 0 if the wheel was started successfully, 1 otherwise.
+int timer_wheel_start(unsigned int tick_ms);
+
+/// Stops the wheel thread, handing every timer still pending to the given function instead of firing it.
+/// @param discard Function called with each pending timer (may be NULL).
+void timer_wheel_stop(void (*discard)(struct TimerEntry *));
+
+/// Schedules a timer.
+/// @note The timer fires once, from the wheel thread, at least delay_ms from now (rounded up to a tick).
+/// Delays longer than the wheel's span fire at the end of its span.
+/// @param entry Timer to schedule (must not be pending).
+/// @param delay_ms Delay before the timer fires, in milliseconds.
+/// @param fire Function called when the timer fires. The wheel does not touch the entry afterwards.
+void timer_schedule(struct TimerEntry *entry, unsigned int delay_ms, void (*fire)(struct TimerEntry *));
+
+/// Cancels a pending timer.
+/// @param entry Timer to cancel.
+/// @return 0 if the timer was cancelled, 1 if it already fired (or is firing).
+int timer_cancel(struct TimerEntry *entry);
+
+#endif  // SERVER_TIMER_WHEEL_H